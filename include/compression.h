@@ -0,0 +1,40 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Formati di compressione supportati, riconosciuti dall'estensione del file
+typedef enum {
+    CODEC_NONE,                // File non compresso
+    CODEC_GZIP,                // .gz (richiede HAVE_ZLIB)
+    CODEC_ZSTD                 // .zst (richiede HAVE_ZSTD)
+} Codec;
+
+// Funzione che riceve i blocchi compressi prodotti da un Encoder
+typedef int (*EncoderEmit)(void* context, const char* data, size_t len);
+
+typedef struct Encoder Encoder;
+
+// Riconosce il formato di compressione dall'estensione del file
+Codec codec_from_filename(const char* filename);
+
+// Restituisce il nome leggibile del formato
+const char* codec_name(Codec codec);
+
+// Legge e decomprime in streaming un file compresso; restituisce un buffer terminato da zero
+char* read_compressed_file(const char* filename, Codec codec, size_t* size);
+
+// Crea un compressore in streaming per il formato indicato
+Encoder* encoder_open(Codec codec);
+
+// Comprime un blocco e passa l'output compresso a emit
+int encoder_write(Encoder* encoder, const char* data, size_t len, EncoderEmit emit, void* context);
+
+// Chiude lo stream compresso emettendo i dati rimasti
+int encoder_finish(Encoder* encoder, EncoderEmit emit, void* context);
+
+// Libera il compressore
+void encoder_free(Encoder* encoder);
+
+#endif
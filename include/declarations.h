@@ -0,0 +1,96 @@
+#ifndef DECLARATIONS_H
+#define DECLARATIONS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lunghezza massima di un nome controllato (i nomi più lunghi vengono ignorati)
+#define DECL_NAME_MAX 256
+
+// Funzione chiamata per ogni nome dichiarato; restituisce false per interrompere l'analisi
+typedef bool (*DeclReport)(void* context, const char* name, int line_number);
+
+// Riconoscimento di una direttiva #line N (o del marcatore "# N") fornita
+// un byte alla volta dall'inizio della riga, senza il '\n' finale
+typedef struct {
+    unsigned char state;       // Posizione raggiunta nella direttiva
+    int value;                 // Numero di riga letto
+} LineDirective;
+
+// Prepara il riconoscimento per una nuova riga
+void line_directive_reset(LineDirective* directive);
+
+// Esamina il byte successivo della riga
+void line_directive_feed(LineDirective* directive, unsigned char c);
+
+// Numero indicato dalla direttiva (0 se la riga non è una direttiva #line)
+int line_directive_value(const LineDirective* directive);
+
+// Tipi di contesto annidato nella pila del parser
+typedef enum {
+    DECL_FRAME_BLOCK,          // Blocco di istruzioni { }
+    DECL_FRAME_STRUCT,         // Corpo di struct/union: contiene dichiarazioni di membri
+    DECL_FRAME_ENUM,           // Corpo di enum
+    DECL_FRAME_PARAMS,         // Lista dei parametri di una funzione
+    DECL_FRAME_FOR,            // Intestazione di un ciclo for
+    DECL_FRAME_SKIP            // Parentesi di un'espressione o di un inizializzatore
+} DeclFrameKind;
+
+// Contesto annidato con lo stato da ripristinare alla chiusura
+typedef struct {
+    unsigned char kind;        // DeclFrameKind
+    unsigned char resume;      // Stato del parser alla chiusura
+    bool have_type;            // Specificatore di tipo già visto nel contesto esterno
+    int decl_paren;            // Parentesi di raggruppamento aperte nel contesto esterno
+} DeclFrame;
+
+// Parser delle dichiarazioni in un'unica passata in avanti.
+// Tutto lo stato è esplicito, quindi l'input può essere fornito a blocchi
+// di qualsiasi dimensione: ogni byte viene esaminato un numero costante di volte.
+typedef struct {
+    DeclReport report;         // Callback per i nomi dichiarati
+    void* context;             // Contesto passato alla callback
+
+    int line_number;           // Riga corrente
+    unsigned char state;       // Stato corrente del parser
+    unsigned char word_context;// Stato in cui è iniziata la parola corrente
+    unsigned char lexical;     // Stato lessicale (stringhe, caratteri, direttive)
+    unsigned char tag_kind;    // Corpo atteso dopo struct/union/enum (DeclFrameKind)
+    bool at_line_start;        // Solo spazi dall'inizio della riga
+    bool have_type;            // Specificatore di tipo visto nella dichiarazione corrente
+    int decl_paren;            // Parentesi di raggruppamento aperte nel dichiaratore
+    bool stopped;              // La callback ha chiesto di interrompere
+
+    char word[DECL_NAME_MAX];  // Parola in lettura (parola chiave o inizio del nome)
+    size_t word_len;
+    char name[DECL_NAME_MAX];  // Nome del dichiaratore in lettura
+    size_t name_len;
+    bool name_overflow;        // Nome troppo lungo, non viene controllato
+    int name_line;             // Riga di inizio del nome
+    LineDirective directive;   // Direttiva #line nella riga corrente
+
+    DeclFrame* frames;         // Pila dei contesti annidati
+    int depth;                 // Numero di contesti aperti
+    int capacity;              // Capacità della pila
+} DeclScanner;
+
+// Inizializza il parser
+void decl_scanner_init(DeclScanner* scanner, DeclReport report, void* context);
+
+// Analizza un blocco di input; restituisce false se l'analisi è stata interrotta
+bool decl_scanner_feed(DeclScanner* scanner, const char* data, size_t len);
+
+// Completa l'analisi alla fine dell'input
+void decl_scanner_finish(DeclScanner* scanner);
+
+// Copia lo stato del parser, compresa la pila dei contesti; restituisce 0 in caso di successo
+int decl_scanner_copy(DeclScanner* dst, const DeclScanner* src);
+
+// Vero se i due parser, alimentati con lo stesso testo, segnalano gli stessi
+// nomi: i numeri di riga possono differire di una costante
+bool decl_scanner_same_state(const DeclScanner* a, const DeclScanner* b);
+
+// Libera la memoria del parser
+void decl_scanner_free(DeclScanner* scanner);
+
+#endif
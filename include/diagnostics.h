@@ -0,0 +1,70 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Struttura per tenere traccia degli errori di variabile
+typedef struct {
+    const char* filename;      // Nome del file dove è stato rilevato l'errore
+    int line_number;           // Numero di riga nel file
+    const char* var_name;      // Nome della variabile non valida
+} InvalidVariable;
+
+// Formati di output disponibili per la diagnostica
+typedef enum {
+    DIAG_FORMAT_TABLE,         // Tabella leggibile (default con --verbose)
+    DIAG_FORMAT_LINE,          // Un errore per riga: file:linea: messaggio
+    DIAG_FORMAT_JSON           // Un oggetto JSON per riga (JSON Lines)
+} DiagFormat;
+
+typedef struct DiagSink DiagSink;
+
+// Formattatore: trasforma i risultati in testo dentro il buffer del sink
+typedef struct {
+    void (*finding)(DiagSink* sink, const InvalidVariable* error);
+    void (*summary)(DiagSink* sink, int checked_vars, int errors_detected);
+} DiagFormatter;
+
+// Sink che riceve gli errori man mano che vengono rilevati e li scrive
+// attraverso un unico buffer di output, senza conservarli in memoria
+struct DiagSink {
+    // Configurazione (impostata da parse_arguments)
+    DiagFormat format;                    // Formato di output
+    char* filename;                       // File di destinazione (NULL = stderr)
+    int max_errors;                       // Numero massimo di errori (0 = nessun limite)
+    bool summary_only;                    // Solo il riepilogo, senza i singoli errori
+    bool enabled;                         // Se falso gli errori vengono solo contati
+
+    // Stato di esecuzione
+    const DiagFormatter* formatter;       // Formattatore selezionato
+    FILE* stream;                         // Stream di destinazione
+    char* buffer;                         // Buffer di output
+    size_t buffer_len;                    // Byte occupati nel buffer
+    int reported;                         // Errori ricevuti dal sink
+    bool limit_reached;                   // Vero se è stato raggiunto --max-errors
+    bool interrupted;                     // Elaborazione interrotta da un limite: riepilogo parziale
+    bool table_started;                   // Vero se l'intestazione della tabella è stata scritta
+    size_t widths[3];                     // Larghezze delle colonne della tabella
+};
+
+// Inizializza il sink con i valori di default
+void diag_sink_init(DiagSink* sink);
+
+// Apre lo stream di destinazione e alloca il buffer
+int diag_sink_open(DiagSink* sink);
+
+// Registra un errore; restituisce false se il limite --max-errors è stato raggiunto
+bool diag_report(DiagSink* sink, const InvalidVariable* error);
+
+// Scrive il riepilogo finale e svuota il buffer
+void diag_sink_finish(DiagSink* sink, int checked_vars, int errors_detected);
+
+// Chiude lo stream e libera la memoria del sink
+void diag_sink_free(DiagSink* sink);
+
+// Converte il nome di un formato nel valore corrispondente
+int diag_parse_format(const char* name, DiagFormat* format);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "compression.h"
+
+// Copia in memoria dell'output non compresso, usata per salvarlo nella cache
+typedef struct {
+    char* data;                // Byte ricevuti
+    size_t len;                // Byte occupati
+    size_t capacity;           // Capacità del buffer
+    bool failed;               // Memoria esaurita: la copia è incompleta
+} OutputCapture;
+
+// Scrittore del file di output.
+// Se il nome termina in .gz o .zst l'output viene compresso in streaming.
+// Con only_if_changed il contenuto viene confrontato man mano con il file
+// esistente: finché coincide non si scrive nulla su disco, e il file viene
+// sostituito (tramite file temporaneo e rename) solo se il contenuto cambia.
+typedef struct {
+    char* path;                // File di destinazione (NULL = stdout)
+    char* temp_path;           // File temporaneo, creato alla prima differenza
+    FILE* stream;              // Stream su cui si sta scrivendo
+    FILE* previous;            // File esistente usato per il confronto
+    Encoder* encoder;          // Compressore in streaming (NULL se non compresso)
+    bool only_if_changed;      // Sostituisce il file solo se il contenuto cambia
+    bool identical;            // Vero finché l'output coincide con il file esistente
+    bool changed;              // Esito finale: il file è stato (ri)scritto
+    size_t written;            // Byte ricevuti finora
+    OutputCapture* capture;    // Se impostato riceve una copia dei dati scritti
+} OutputWriter;
+
+// Apre l'output; path NULL indica stdout
+int output_open(OutputWriter* writer, const char* path, bool only_if_changed);
+
+// Scrive un blocco di dati
+int output_write(OutputWriter* writer, const char* data, size_t len);
+
+// Completa la scrittura e, se necessario, sostituisce atomicamente il file
+int output_commit(OutputWriter* writer);
+
+// Interrompe la scrittura eliminando il file temporaneo
+void output_abort(OutputWriter* writer);
+
+#endif
@@ -4,6 +4,18 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <getopt.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "declarations.h"
+#include "diagnostics.h"
+#include "output.h"
+#include "utf8.h"
+#include "trace.h"
+#include "probes.h"
+#include "strset.h"
 
 // Struttura per tenere traccia delle statistiche di elaborazione
 typedef struct {
@@ -17,32 +29,155 @@ typedef struct {
     int output_size;           // Dimensione in byte del file di output
 } Stats;
 
-// Struttura per tenere traccia degli errori di variabile
+// Stati dell'automa che rimuove i commenti
+typedef enum {
+    COMMENT_STATE_CODE,                   // Codice normale
+    COMMENT_STATE_SLASH,                  // Letto un '/', in attesa del carattere successivo
+    COMMENT_STATE_LINE,                   // Dentro un commento //
+    COMMENT_STATE_LINE_ESCAPE,            // Backslash dentro un commento //
+    COMMENT_STATE_BLOCK,                  // Dentro un commento /* */
+    COMMENT_STATE_BLOCK_STAR,             // Letto un '*' dentro un commento /* */
+    COMMENT_STATE_STRING,                 // Dentro una stringa letterale
+    COMMENT_STATE_STRING_ESCAPE,          // Sequenza di escape in una stringa
+    COMMENT_STATE_CHAR,                   // Dentro un carattere letterale
+    COMMENT_STATE_CHAR_ESCAPE,            // Sequenza di escape in un carattere
+    COMMENT_STATE_COUNT
+} CommentState;
+
+// Byte che la compattazione di un blocco può scrivere oltre la sua lunghezza
+// e gli spazi in sospeso: righe vuote o marcatore #line dei blocchi precedenti
+#define COMPACT_SLACK 64
+
+// Stato della compattazione delle righe vuote, mantenuto tra blocchi
+typedef struct {
+    int line;                             // Numero della riga corrente nell'output non compattato
+    size_t blank_lines;                   // Righe vuote consecutive non ancora emesse
+    size_t blank_bytes;                   // Byte occupati da quelle righe
+    char* spaces;                         // Spazi in sospeso nella riga corrente
+    size_t space_len;                     // Numero di spazi in sospeso
+    size_t space_capacity;                // Dimensione allocata per gli spazi
+    bool line_has_text;                   // La riga corrente contiene testo
+    bool continued;                       // La riga precedente termina con '\' e prosegue
+    char last;                            // Ultimo carattere di testo della riga corrente
+    LineDirective directive;              // Direttiva #line nella riga corrente
+} Compactor;
+
+// Passi eseguiti sul file di input (combinabili)
+typedef enum {
+    PASS_INCLUDES = 1 << 0,               // Risoluzione degli #include
+    PASS_COMMENTS = 1 << 1,               // Rimozione dei commenti
+    PASS_CHECK = 1 << 2,                  // Controllo dei nomi delle variabili
+    PASS_OUTPUT = 1 << 3,                 // Scrittura dell'output
+    PASS_ALL = PASS_INCLUDES | PASS_COMMENTS | PASS_CHECK | PASS_OUTPUT
+} Pass;
+
+// Trattamento degli #include <...>
+typedef enum {
+    SYSTEM_HEADERS_EXPAND,                // Espansi come gli #include "..."
+    SYSTEM_HEADERS_KEEP,                  // Direttiva lasciata invariata, senza accedere al filesystem
+    SYSTEM_HEADERS_STUB                   // Rimossi se nell'elenco degli stub, altrimenti lasciati invariati
+} SystemHeaderMode;
+
+// Esito di run_fast_path
+typedef enum {
+    FAST_PATH_DONE,                       // Input elaborato interamente
+    FAST_PATH_SKIPPED,                    // Input non adatto: va elaborato normalmente
+    FAST_PATH_FAILED                      // Errore durante la scrittura
+} FastPathResult;
+
+// Fasi dell'elaborazione, misurate singolarmente
+typedef enum {
+    STAGE_READ,                           // Lettura del file di input
+    STAGE_INCLUDES,                       // Risoluzione degli #include
+    STAGE_COMMENTS,                       // Rimozione dei commenti
+    STAGE_CHECK,                          // Controllo dei nomi delle variabili
+    STAGE_WRITE,                          // Scrittura dell'output
+    STAGE_COUNT
+} Stage;
+
+// Limiti sulle risorse usate per un file di input (0 = nessun limite)
 typedef struct {
-    char* filename;            // Nome del file dove è stato rilevato l'errore
-    int line_number;           // Numero di riga nel file
-    char* var_name;            // Nome della variabile non valida
-} InvalidVariable;
+    int max_include_depth;                // Profondità massima degli #include annidati
+    int max_includes;                     // Numero massimo di file inclusi
+    long long max_expanded_bytes;         // Byte massimi prodotti dall'espansione degli #include
+    uint64_t time_budget_ns;              // Tempo massimo di elaborazione
+} Limits;
 
 // Struttura per tenere traccia di un file incluso
 typedef struct {
     char* filename;            // Nome del file incluso
     int size;                  // Dimensione in byte
     int lines;                 // Numero di righe
+    int requests;              // Numero di volte in cui è stato richiesto con #include
+    int stripped_size;         // Byte contribuiti dal testo proprio dopo la rimozione dei commenti
+    int depth;                 // Profondità nell'albero degli include (1 = incluso dall'input)
+    int parent;                // Indice del file che lo include (-1 = file di input)
+    uint64_t read_ns;          // Tempo speso per leggere il file
+    uint64_t total_ns;         // Tempo speso per leggerlo ed espanderlo, include annidati compresi
 } IncludedFile;
 
+// Unità di compilazione in modalità unity build
+typedef struct {
+    char* filename;            // File di input
+    Stats stats;               // Statistiche della sola unità
+} TranslationUnit;
+
+// Esito di cache_lookup
+typedef enum {
+    CACHE_HIT,                            // Risultato riprodotto dalla cache
+    CACHE_MISS,                           // Input da elaborare normalmente
+    CACHE_FAILED                          // Risultato trovato ma non scritto in output
+} CacheResult;
+
+// Stato della cache dei risultati durante un'elaborazione (definita in cache.c)
+typedef struct Cache Cache;
+
+// Consumatore dell'output di resolve_includes; restituisce 0 se il blocco è stato accettato
+typedef int (*IncludeSink)(void* context, const char* data, size_t len);
+
 // Struttura principale del programma
 typedef struct {
     Stats stats;                          // Statistiche di elaborazione
-    InvalidVariable** errors;             // Array di errori rilevati
+    DiagSink diagnostics;                 // Sink degli errori rilevati
     IncludedFile** included_files;        // Array di file inclusi
+    int included_files_capacity;          // Capacità dell'array di file inclusi
+    int current_include;                  // Indice del file in espansione (-1 = file di input)
     char* input_filename;                 // Nome del file di input
     char* output_filename;                // Nome del file di output
     bool verbose;                         // Flag per l'output delle statistiche
+    bool only_if_changed;                 // Riscrive l'output solo se il contenuto cambia
+    bool output_unchanged;                // Vero se l'output coincideva con il file esistente
+    bool include_report;                  // Stampa il report dei costi dei file inclusi
+    char* include_folded_filename;        // File in formato folded-stack per i flame graph
+    char* metrics_filename;               // File textfile di Prometheus da aggiornare
+    char* trace_filename;                 // File in cui scrivere il trace degli eventi
+    uint64_t stage_ns[STAGE_COUNT];       // Durata di ogni fase in nanosecondi
+    bool stage_ran[STAGE_COUNT];          // Fasi effettivamente eseguite
+    Limits limits;                        // Limiti sulle risorse
+    uint64_t deadline_ns;                 // Istante oltre il quale l'elaborazione viene interrotta
+    long long expanded_bytes;             // Byte prodotti finora dall'espansione degli #include
+    bool aborted;                         // Elaborazione interrotta per superamento di un limite
+    int passes;                           // Passi da eseguire (maschera di Pass)
+    SystemHeaderMode system_headers;      // Trattamento degli #include <...>
+    StringSet system_stubs;               // Header di sistema rimossi in modalità stub
+    bool pipelined;                       // Esegue le fasi in parallelo su thread separati
+    bool unity;                           // Unisce più file di input in un unico output
+    TranslationUnit* units;               // Unità di compilazione in modalità unity
+    int unit_count;                       // Numero di unità di compilazione
+    IncludeSink include_sink;             // Se impostato riceve l'output di resolve_includes a blocchi
+    void* include_sink_context;           // Contesto passato a include_sink
+    bool compact;                         // Compatta le righe vuote durante la rimozione dei commenti
+    char* incremental_filename;           // File dei checkpoint per l'elaborazione incrementale
+    int missing_includes;                 // #include di file che non è stato possibile leggere
+    char* cache_dir;                      // Directory della cache dei risultati (NULL = disattivata)
+    long long cache_max_bytes;            // Dimensione massima della cache
+    Cache* cache;                         // Risultato in registrazione dopo un mancato
+    OutputCapture* output_capture;        // Se impostato riceve una copia dell'output scritto
 } PreCompiler;
 
-// Legge il contenuto di un file e restituisce una stringa
-char *read_file_content(const char *filename, int *size, int *lines);
+// Legge il contenuto di un file e restituisce una stringa; gli avvisi sulla
+// codifica vengono registrati anche nella cache, se attiva
+char *read_file_content(PreCompiler *compiler, const char *filename, int *size, int *lines);
 
 // Analizza gli argomenti della riga di comando
 int parse_arguments(int argc, char* argv[], PreCompiler* compiler);
@@ -53,12 +188,101 @@ char* resolve_includes(const char* content, PreCompiler* compiler);
 // Controlla la validità del nome variabili
 char* check_variables_name(const char* content, PreCompiler* compiler);
 
+// Controlla i nomi senza produrre output: espansione degli #include e rimozione
+// dei commenti procedono a blocchi verso il parser, senza buffer intermedi
+int check_variables_only(const char* content, PreCompiler* compiler);
+
+// Callback del parser delle dichiarazioni: conta il nome e segnala se non è valido
+bool report_declared_name(void* context, const char* name, int line_number);
+
 // Rimuove tutti i commenti dal codice
 char* remove_comments(const char* content, PreCompiler* compiler);
 
+// Elabora un blocco di input con l'automa dei commenti, mantenendo lo stato tra blocchi
+size_t strip_comments(CommentState* state, const char* input, size_t len, char* output, int* comment_lines);
+
+// Attiva i probe dei commenti per un blocco che inizia alla posizione offset
+// del testo espanso; va chiamata prima di strip_comments, con lo stesso stato
+void comment_probes(CommentState state, const char* input, size_t len, size_t offset);
+
+// Completa l'elaborazione alla fine dell'input
+size_t strip_comments_finish(CommentState* state, char* output);
+
+// Inizializza lo stato della compattazione
+void compactor_init(Compactor* compactor);
+
+// Libera la memoria della compattazione
+void compactor_free(Compactor* compactor);
+
+// Compatta un blocco di testo privo di commenti: elimina gli spazi a fine riga
+// e sostituisce le sequenze di righe vuote con un marcatore #line, così i
+// numeri di riga restano quelli dell'output non compattato. output deve poter
+// contenere compact_capacity(compactor, len) byte; può coincidere con input se
+// il blocco è la prosecuzione, nello stesso buffer, di quelli già compattati.
+size_t compact_lines(Compactor* compactor, const char* input, size_t len, char* output);
+
+// Byte che compact_lines può scrivere compattando un blocco di len byte
+size_t compact_capacity(const Compactor* compactor, size_t len);
+
 // Stampa le statistiche di elaborazione
 void print_stats(const PreCompiler* compiler);
 
+// Stampa il report dei costi dei file inclusi, ordinato per costo
+void print_include_report(const PreCompiler* compiler);
+
+// Scrive i costi dei file inclusi in formato folded-stack (flame graph)
+int write_include_folded(const PreCompiler* compiler, const char* filename);
+
+// Aggiorna il file di metriche Prometheus sommando quelle di questa esecuzione
+// (failed: l'esecuzione è terminata con un errore)
+int update_metrics_file(const PreCompiler* compiler, const char* filename, bool failed);
+
+// Se l'input non contiene direttive né commenti lo copia in output nel kernel,
+// senza passarlo dalle fasi di elaborazione
+FastPathResult run_fast_path(PreCompiler* compiler);
+
+// Vero se l'input va letto come flusso: stdin ("-"), pipe, FIFO o dispositivo
+bool is_stream_input(const char* filename);
+
+// Legge l'input a blocchi e scrive l'output man mano che viene prodotto
+int run_streaming(PreCompiler* compiler);
+
+// Elabora tutte le unità di compilazione scrivendo un unico output, espandendo
+// ogni header una sola volta per tutte le unità
+int run_unity(PreCompiler* compiler);
+
+// Rimuove i commenti e controlla i nomi del testo espanso rielaborando solo
+// le regioni cambiate dall'esecuzione precedente, poi scrive l'output
+int run_incremental(PreCompiler* compiler, const char* content);
+
+// Esegue le fasi dopo la lettura su thread separati e scrive l'output
+int run_pipeline(PreCompiler* compiler, const char* content);
+
+// Cerca l'input nella cache dei risultati; se presente riproduce output,
+// statistiche ed errori senza eseguire le fasi di elaborazione
+CacheResult cache_lookup(PreCompiler* compiler);
+
+// Registra un errore rilevato, da salvare con il risultato
+void cache_record_error(Cache* cache, int line_number, const char* var_name);
+
+// Registra un avviso stampato durante la lettura, da riprodurre con il risultato
+void cache_record_warning(Cache* cache, const char* message);
+
+// Salva nella cache il risultato di un'elaborazione completata
+void cache_store(PreCompiler* compiler);
+
+// Libera lo stato della cache
+void cache_free(Cache* cache);
+
+// Verifica il limite di tempo; se è superato segnala l'errore e interrompe l'elaborazione
+bool time_budget_exceeded(PreCompiler* compiler, const char* where);
+
+// Restituisce il nome di una fase dell'elaborazione
+const char* stage_name(Stage stage);
+
+// Restituisce il tempo di un orologio monotono in nanosecondi
+uint64_t monotonic_ns(void);
+
 // Funzione di utilità per verificare se una variabile è valida
 bool is_valid_name(const char* name);
 
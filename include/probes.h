@@ -0,0 +1,53 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// Punti di tracciamento statici (USDT) del provider "myprecompiler".
+// Quando sys/sdt.h è disponibile (HAVE_SDT) ogni probe è una singola nop
+// registrata nella sezione .note.stapsdt dell'eseguibile, con un semaforo
+// che bpftrace o perf incrementano quando vi si agganciano, ad esempio con
+//   bpftrace -e 'usdt:./bin/myPreCompiler:myprecompiler:include__close { ... }'
+// Ogni punto controlla il semaforo con myprecompiler_<probe>_ENABLED() prima
+// di calcolare gli argomenti: senza tracer il costo è un confronto.
+// Senza sys/sdt.h i controlli valgono 0 e le macro non generano codice.
+//
+// Probe disponibili:
+//   include__open(file, depth)              apertura di un file incluso
+//   include__close(file, bytes, ns)         fine dell'espansione di un file incluso
+//   invalid__name(file, line, name)         nome di variabile non valido
+//   comment__start(offset, kind)            inizio di un commento (1 = //, 2 = /* */)
+//   comment__end(offset)                    fine di un commento
+//   output__write(file, bytes)              scrittura dell'output ("-" = stdout)
+// Gli offset dei commenti sono posizioni nel testo con gli #include espansi.
+
+#ifdef HAVE_SDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// Semafori dei probe, definiti in probes.c nella sezione .probes
+#define PROBE_SEMAPHORE(name) myprecompiler_##name##_semaphore
+extern volatile unsigned short PROBE_SEMAPHORE(include__open);
+extern volatile unsigned short PROBE_SEMAPHORE(include__close);
+extern volatile unsigned short PROBE_SEMAPHORE(invalid__name);
+extern volatile unsigned short PROBE_SEMAPHORE(comment__start);
+extern volatile unsigned short PROBE_SEMAPHORE(comment__end);
+extern volatile unsigned short PROBE_SEMAPHORE(output__write);
+
+#define PROBE_ENABLED(name) __builtin_expect(PROBE_SEMAPHORE(name) != 0, 0)
+#define PROBE1(name, a) DTRACE_PROBE1(myprecompiler, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(myprecompiler, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(myprecompiler, name, a, b, c)
+#else
+#define PROBE_ENABLED(name) 0
+#define PROBE1(name, a) do { (void)sizeof(a); } while (0)
+#define PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define PROBE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
+
+#define myprecompiler_include__open_ENABLED() PROBE_ENABLED(include__open)
+#define myprecompiler_include__close_ENABLED() PROBE_ENABLED(include__close)
+#define myprecompiler_invalid__name_ENABLED() PROBE_ENABLED(invalid__name)
+#define myprecompiler_comment__start_ENABLED() PROBE_ENABLED(comment__start)
+#define myprecompiler_comment__end_ENABLED() PROBE_ENABLED(comment__end)
+#define myprecompiler_output__write_ENABLED() PROBE_ENABLED(output__write)
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef STRSET_H
+#define STRSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Insieme di stringhe con indirizzamento aperto: ogni ricerca calcola un
+// solo hash e confronta in media una stringa
+typedef struct {
+    char** slots;              // Stringhe copiate (NULL = slot libero)
+    size_t capacity;           // Numero di slot (potenza di 2)
+    size_t count;              // Stringhe presenti
+} StringSet;
+
+// Inizializza un insieme vuoto
+void strset_init(StringSet* set);
+
+// Aggiunge una copia della stringa; restituisce 0 in caso di successo
+int strset_add(StringSet* set, const char* text);
+
+// Aggiunge gli elementi di una lista separata da virgole
+int strset_add_list(StringSet* set, const char* list);
+
+// Verifica se la stringa (di lunghezza len, non necessariamente terminata) è presente
+bool strset_contains(const StringSet* set, const char* text, size_t len);
+
+// Svuota l'insieme e libera la memoria
+void strset_free(StringSet* set);
+
+#endif
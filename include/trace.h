@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Evento del trace: inizio ('B') o fine ('E') di un intervallo
+typedef struct {
+    uint64_t ts_ns;            // Istante dell'evento (orologio monotono)
+    char* name;                // Nome dell'intervallo (solo per gli eventi 'B')
+    const char* category;      // Categoria dell'intervallo (solo per gli eventi 'B')
+    char phase;                // 'B' oppure 'E'
+} TraceEvent;
+
+// Eventi registrati da un singolo thread.
+// Ogni thread scrive solo nel proprio buffer, quindi la registrazione non
+// richiede sincronizzazione; il lock serve solo per creare il buffer.
+typedef struct TraceBuffer {
+    TraceEvent* events;
+    size_t count;
+    size_t capacity;
+    int tid;                   // Identificativo della traccia nel file
+    char* thread_name;         // Nome mostrato per la traccia (può essere NULL)
+    struct TraceBuffer* next;  // Buffer del thread registrato prima di questo
+} TraceBuffer;
+
+// Vero se la registrazione del trace è attiva
+extern bool trace_enabled;
+
+// Attiva la registrazione; i tempi sono relativi a questo istante
+void trace_start(void);
+
+// Assegna un nome alla traccia del thread corrente
+void trace_set_thread_name(const char* name);
+
+// Apre un intervallo annidato nel thread corrente (il nome viene copiato)
+void trace_begin(const char* category, const char* name);
+
+// Chiude l'ultimo intervallo aperto nel thread corrente
+void trace_end(void);
+
+// Scrive gli eventi nel formato Chrome Trace Event (JSON), leggibile da
+// chrome://tracing e da Perfetto, e libera i buffer
+int trace_write(const char* filename);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decodifica un carattere UTF-8 all'inizio di s (al massimo len byte).
+// Restituisce il numero di byte usati, o 0 se la sequenza non è valida
+// (troncata, sovralunga, surrogato o oltre U+10FFFF).
+size_t utf8_decode(const unsigned char* s, size_t len, uint32_t* codepoint);
+
+// Verifica che il buffer sia UTF-8 valido; in caso contrario restituisce false
+// e scrive in error_offset la posizione del primo byte non valido.
+// I blocchi di soli caratteri ASCII vengono saltati 16 byte alla volta.
+bool utf8_validate(const char* data, size_t len, size_t* error_offset);
+
+// Caratteri ammessi negli identificatori (C11, allegato D)
+bool utf8_is_identifier_start(uint32_t codepoint);
+bool utf8_is_identifier_continue(uint32_t codepoint);
+
+#endif
@@ -0,0 +1,790 @@
+#include "../include/precompiler.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// Versione del formato delle voci: cambia il nome delle chiavi, così le voci
+// scritte da versioni precedenti non vengono mai lette
+#define CACHE_FORMAT "myPreCompiler-cache 3"
+
+// Blocco letto per calcolare l'hash di un file
+#define CACHE_READ_CHUNK (64 * 1024)
+
+// Dopo uno sfratto la cache occupa al più questa frazione della dimensione massima
+#define CACHE_EVICT_PERCENT 90
+
+// Hash FNV-1a a 128 bit
+typedef unsigned __int128 CacheHash;
+
+#define FNV128_OFFSET (((CacheHash)0x6c62272e07bb0142ull << 64) | 0x62b821756295c58dull)
+#define FNV128_PRIME (((CacheHash)0x0000000001000000ull << 64) | 0x000000000000013bull)
+
+// Errore rilevato durante l'elaborazione, da salvare con il risultato
+typedef struct
+{
+    int line_number;
+    char *var_name;
+} CachedError;
+
+struct Cache
+{
+    char input_key[33];        // Hash di opzioni, nome e contenuto dell'input
+    OutputCapture capture;     // Copia dell'output prodotto
+    CachedError *errors;       // Errori passati al sink, nell'ordine di rilevamento
+    int error_count;
+    int error_capacity;
+    char **warnings;           // Avvisi stampati durante la lettura di input e inclusi
+    int warning_count;
+    int warning_capacity;
+    struct timespec started;   // Inizio dell'elaborazione, prima del calcolo della chiave
+    off_t input_size;          // Dimensione dell'input da cui è calcolata la chiave
+    struct timespec input_mtime; // Data di modifica dello stesso input
+    bool failed;               // Memoria esaurita: il risultato non viene salvato
+};
+
+static void hash_update(CacheHash *hash, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    CacheHash h = *hash;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= FNV128_PRIME;
+    }
+    *hash = h;
+}
+
+// Aggiunge una stringa compreso il terminatore, così che "ab"+"c" e "a"+"bc" differiscano
+static void hash_string(CacheHash *hash, const char *text)
+{
+    hash_update(hash, text, strlen(text) + 1);
+}
+
+// Aggiunge all'hash il contenuto di un file; restituisce false se non è leggibile
+static bool hash_file(CacheHash *hash, const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return false;
+
+    char *buffer = (char *)malloc(CACHE_READ_CHUNK);
+    if (!buffer)
+    {
+        fclose(file);
+        return false;
+    }
+    size_t n;
+    while ((n = fread(buffer, 1, CACHE_READ_CHUNK, file)) > 0)
+        hash_update(hash, buffer, n);
+    bool ok = !ferror(file);
+    free(buffer);
+    fclose(file);
+    return ok;
+}
+
+static void hash_to_hex(CacheHash hash, char hex[33])
+{
+    snprintf(hex, 33, "%016llx%016llx", (unsigned long long)(hash >> 64), (unsigned long long)hash);
+}
+
+// Costruisce il percorso dir/ab/abcdef...suffix; le prime due cifre
+// distribuiscono le voci in sottodirectory
+static char *entry_path(const char *dir, const char *key, const char *suffix)
+{
+    size_t len = strlen(dir) + strlen(key) + strlen(suffix) + 5;
+    char *path = (char *)malloc(len);
+    if (path)
+        snprintf(path, len, "%s/%.2s/%s%s", dir, key, key, suffix);
+    return path;
+}
+
+// Calcola la chiave dell'input: tutte le opzioni che cambiano output, errori o report
+static bool compute_input_key(const PreCompiler *compiler, char key[33])
+{
+    char options[256];
+    snprintf(options, sizeof(options),
+             "passes=%d system=%d depth=%d includes=%d expanded=%lld errors=%d report=%d compact=%d",
+             compiler->passes, (int)compiler->system_headers, compiler->limits.max_include_depth,
+             compiler->limits.max_includes, compiler->limits.max_expanded_bytes, compiler->diagnostics.max_errors,
+             compiler->include_report || compiler->include_folded_filename ? 1 : 0, compiler->compact ? 1 : 0);
+
+    CacheHash hash = FNV128_OFFSET;
+    hash_string(&hash, CACHE_FORMAT);
+    hash_string(&hash, options);
+    for (size_t i = 0; i < compiler->system_stubs.capacity; i++)
+    {
+        if (compiler->system_stubs.slots[i])
+            hash_string(&hash, compiler->system_stubs.slots[i]);
+    }
+
+    // Il nome dell'input compare nelle diagnostiche e nei report
+    hash_string(&hash, compiler->input_filename);
+    if (!hash_file(&hash, compiler->input_filename))
+        return false;
+    hash_to_hex(hash, key);
+    return true;
+}
+
+// La chiave del risultato aggiunge a quella dell'input nome e contenuto di
+// ogni file incluso. Restituisce false se uno dei file non è più leggibile.
+static bool compute_result_key(const char *input_key, char **filenames, int count, char key[33])
+{
+    CacheHash hash = FNV128_OFFSET;
+    hash_string(&hash, input_key);
+    for (int i = 0; i < count; i++)
+    {
+        CacheHash file_hash = FNV128_OFFSET;
+        if (!hash_file(&file_hash, filenames[i]))
+            return false;
+        hash_string(&hash, filenames[i]);
+        hash_update(&hash, &file_hash, sizeof(file_hash));
+    }
+    hash_to_hex(hash, key);
+    return true;
+}
+
+// Legge una stringa di lunghezza nota seguita da '\n'
+static char *read_name(FILE *file, size_t len)
+{
+    char *name = (char *)malloc(len + 1);
+    if (!name)
+        return NULL;
+    if (fread(name, 1, len, file) != len || fgetc(file) != '\n')
+    {
+        free(name);
+        return NULL;
+    }
+    name[len] = '\0';
+    return name;
+}
+
+static void free_names(char **names, int count)
+{
+    for (int i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+}
+
+// Legge il manifest dell'input: l'elenco dei file inclusi dall'ultima elaborazione
+static char **read_manifest(const char *path, int *count)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    char header[64];
+    int n;
+    if (!fgets(header, sizeof(header), file) || strcmp(header, CACHE_FORMAT "\n") != 0 ||
+        fscanf(file, "files %d\n", &n) != 1 || n < 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    char **names = (char **)calloc(n > 0 ? n : 1, sizeof(char *));
+    int loaded = 0;
+    while (names && loaded < n)
+    {
+        size_t len;
+        if (fscanf(file, "%zu", &len) != 1 || fgetc(file) != ' ' || !(names[loaded] = read_name(file, len)))
+            break;
+        loaded++;
+    }
+    fclose(file);
+
+    if (loaded < n)
+    {
+        free_names(names, loaded);
+        return NULL;
+    }
+    *count = n;
+    return names;
+}
+
+// Rende la voce la più recente per lo sfratto LRU
+static void touch_entry(const char *path)
+{
+    utimensat(AT_FDCWD, path, NULL, 0);
+}
+
+// Carica un risultato salvato e lo riproduce: statistiche, file inclusi,
+// avvisi di lettura, errori inviati al sink e output. Restituisce 1 se la
+// voce non è valida.
+static int replay_result(PreCompiler *compiler, FILE *file, int *write_status)
+{
+    char header[64];
+    Stats stats;
+    int error_count;
+    if (!fgets(header, sizeof(header), file) || strcmp(header, CACHE_FORMAT "\n") != 0 ||
+        fscanf(file, "stats %d %d %d %d %d %d %d %d\n", &stats.checked_vars, &stats.errors_detected,
+               &stats.comment_lines_deleted, &stats.files_included, &stats.input_lines, &stats.input_size,
+               &stats.output_lines, &stats.output_size) != 8 ||
+        stats.files_included < 0)
+        return 1;
+
+    // Ricostruisce la tabella dei file inclusi usata da --verbose e dai report
+    IncludedFile **files = (IncludedFile **)calloc(stats.files_included > 0 ? stats.files_included : 1, sizeof(IncludedFile *));
+    if (!files)
+        return 1;
+    int loaded = 0;
+    for (; loaded < stats.files_included; loaded++)
+    {
+        IncludedFile *entry = (IncludedFile *)calloc(1, sizeof(IncludedFile));
+        size_t len;
+        if (!entry || fscanf(file, "%d %d %d %d %d %d %zu", &entry->size, &entry->lines, &entry->requests,
+                             &entry->stripped_size, &entry->depth, &entry->parent, &len) != 7 ||
+            entry->parent < -1 || entry->parent >= loaded || fgetc(file) != ' ' ||
+            !(entry->filename = read_name(file, len)))
+        {
+            free(entry);
+            break;
+        }
+        files[loaded] = entry;
+    }
+
+    // Gli errori vengono letti tutti prima di inviarli al sink, così una
+    // voce troncata non produce diagnostiche parziali
+    CachedError *errors = NULL;
+    int errors_loaded = 0;
+    bool valid = loaded == stats.files_included && fscanf(file, "errors %d\n", &error_count) == 1 && error_count >= 0;
+    if (valid && error_count > 0)
+    {
+        errors = (CachedError *)malloc(error_count * sizeof(CachedError));
+        valid = errors != NULL;
+    }
+    while (valid && errors_loaded < error_count)
+    {
+        size_t len;
+        CachedError *error = &errors[errors_loaded];
+        if (fscanf(file, "%d %zu", &error->line_number, &len) != 2 || fgetc(file) != ' ' ||
+            !(error->var_name = read_name(file, len)))
+        {
+            valid = false;
+            break;
+        }
+        errors_loaded++;
+    }
+
+    // Gli avvisi sulla codifica stampati dalla lettura vengono ripetuti
+    char **warnings = NULL;
+    int warning_count = 0, warnings_loaded = 0;
+    if (valid && (fscanf(file, "warnings %d\n", &warning_count) != 1 || warning_count < 0))
+        valid = false;
+    if (valid && warning_count > 0)
+    {
+        warnings = (char **)malloc(warning_count * sizeof(char *));
+        valid = warnings != NULL;
+    }
+    while (valid && warnings_loaded < warning_count)
+    {
+        size_t len;
+        if (fscanf(file, "%zu", &len) != 1 || fgetc(file) != ' ' || !(warnings[warnings_loaded] = read_name(file, len)))
+        {
+            valid = false;
+            break;
+        }
+        warnings_loaded++;
+    }
+
+    size_t output_len = 0;
+    char *output = NULL;
+    if (valid && (fscanf(file, "output %zu", &output_len) != 1 || fgetc(file) != '\n'))
+        valid = false;
+    if (valid && output_len > 0)
+    {
+        output = (char *)malloc(output_len);
+        valid = output && fread(output, 1, output_len, file) == output_len;
+    }
+
+    if (valid)
+    {
+        compiler->stats = stats;
+        compiler->included_files = files;
+        compiler->included_files_capacity = stats.files_included > 0 ? stats.files_included : 1;
+        files = NULL;
+
+        for (int i = 0; i < warnings_loaded; i++)
+            fprintf(stderr, "%s\n", warnings[i]);
+        for (int i = 0; i < errors_loaded; i++)
+        {
+            InvalidVariable error = {compiler->input_filename, errors[i].line_number, errors[i].var_name};
+            if (!diag_report(&compiler->diagnostics, &error))
+                break;
+        }
+
+        *write_status = 0;
+        if (compiler->passes & PASS_OUTPUT)
+        {
+            trace_begin("stage", stage_name(STAGE_WRITE));
+            uint64_t start = monotonic_ns();
+            OutputWriter writer;
+            if (output_open(&writer, compiler->output_filename, compiler->only_if_changed) != 0)
+            {
+                *write_status = 1;
+            }
+            else if (output_write(&writer, output, output_len) != 0)
+            {
+                output_abort(&writer);
+                *write_status = 1;
+            }
+            else if (output_commit(&writer) != 0)
+            {
+                *write_status = 1;
+            }
+            else
+            {
+                compiler->output_unchanged = !writer.changed;
+            }
+            compiler->stage_ns[STAGE_WRITE] = monotonic_ns() - start;
+            compiler->stage_ran[STAGE_WRITE] = true;
+            trace_end();
+        }
+    }
+
+    if (files)
+    {
+        for (int i = 0; i < loaded; i++)
+        {
+            free(files[i]->filename);
+            free(files[i]);
+        }
+        free(files);
+    }
+    for (int i = 0; i < errors_loaded; i++)
+        free(errors[i].var_name);
+    free(errors);
+    if (warnings)
+        free_names(warnings, warnings_loaded);
+    free(output);
+    return valid ? 0 : 1;
+}
+
+// Cerca il risultato dell'input nella cache e, se presente, lo riproduce
+CacheResult cache_lookup(PreCompiler *compiler)
+{
+    // stdin e pipe non si possono rileggere per calcolare la chiave
+    if (!compiler->cache_dir || compiler->unity || is_stream_input(compiler->input_filename))
+        return CACHE_MISS;
+
+    Cache *cache = (Cache *)calloc(1, sizeof(Cache));
+    if (!cache)
+        return CACHE_MISS;
+    trace_begin("stage", "cache");
+
+    // Dimensione e data di modifica vengono lette prima del contenuto: se
+    // cambiano entro cache_store, il testo elaborato può non essere quello
+    // da cui è stata calcolata la chiave
+    struct stat st;
+    clock_gettime(CLOCK_REALTIME, &cache->started);
+    if (stat(compiler->input_filename, &st) != 0 || !compute_input_key(compiler, cache->input_key))
+    {
+        // Input illeggibile: l'errore viene segnalato dalla lettura normale
+        free(cache);
+        trace_end();
+        return CACHE_MISS;
+    }
+
+    CacheResult result = CACHE_MISS;
+    char *manifest_path = entry_path(compiler->cache_dir, cache->input_key, ".manifest");
+    int count = 0;
+    char **names = manifest_path ? read_manifest(manifest_path, &count) : NULL;
+    char result_key[33];
+    if (names && compute_result_key(cache->input_key, names, count, result_key))
+    {
+        char *result_path = entry_path(compiler->cache_dir, result_key, ".result");
+        FILE *file = result_path ? fopen(result_path, "rb") : NULL;
+        int write_status;
+        if (file && replay_result(compiler, file, &write_status) == 0)
+        {
+            result = write_status == 0 ? CACHE_HIT : CACHE_FAILED;
+            touch_entry(manifest_path);
+            touch_entry(result_path);
+        }
+        if (file)
+            fclose(file);
+        free(result_path);
+    }
+    if (names)
+        free_names(names, count);
+    free(manifest_path);
+    trace_end();
+
+    if (result != CACHE_MISS)
+    {
+        free(cache);
+        return result;
+    }
+
+    // Mancato: l'elaborazione normale registra output ed errori per cache_store
+    cache->input_size = st.st_size;
+    cache->input_mtime = st.st_mtim;
+    compiler->cache = cache;
+    compiler->output_capture = &cache->capture;
+    return CACHE_MISS;
+}
+
+// Registra un errore inviato al sink durante un'elaborazione da salvare
+void cache_record_error(Cache *cache, int line_number, const char *var_name)
+{
+    if (cache->failed)
+        return;
+    if (cache->error_count == cache->error_capacity)
+    {
+        int new_capacity = cache->error_capacity ? cache->error_capacity * 2 : 16;
+        CachedError *errors = (CachedError *)realloc(cache->errors, new_capacity * sizeof(CachedError));
+        if (!errors)
+        {
+            cache->failed = true;
+            return;
+        }
+        cache->errors = errors;
+        cache->error_capacity = new_capacity;
+    }
+    char *copy = strdup(var_name);
+    if (!copy)
+    {
+        cache->failed = true;
+        return;
+    }
+    cache->errors[cache->error_count].line_number = line_number;
+    cache->errors[cache->error_count].var_name = copy;
+    cache->error_count++;
+}
+
+// Registra un avviso stampato durante un'elaborazione da salvare
+void cache_record_warning(Cache *cache, const char *message)
+{
+    if (cache->failed)
+        return;
+    if (cache->warning_count == cache->warning_capacity)
+    {
+        int new_capacity = cache->warning_capacity ? cache->warning_capacity * 2 : 4;
+        char **warnings = (char **)realloc(cache->warnings, new_capacity * sizeof(char *));
+        if (!warnings)
+        {
+            cache->failed = true;
+            return;
+        }
+        cache->warnings = warnings;
+        cache->warning_capacity = new_capacity;
+    }
+    char *copy = strdup(message);
+    if (!copy)
+    {
+        cache->failed = true;
+        return;
+    }
+    cache->warnings[cache->warning_count++] = copy;
+}
+
+static bool same_time(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static bool modified_since(const char *filename, struct timespec since)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        return true;
+    return st.st_mtim.tv_sec > since.tv_sec ||
+           (st.st_mtim.tv_sec == since.tv_sec && st.st_mtim.tv_nsec >= since.tv_nsec);
+}
+
+// Verifica che nessun file sia cambiato durante l'elaborazione: l'input deve
+// avere ancora dimensione e data di modifica lette prima della chiave, e gli
+// inclusi, il cui hash viene calcolato solo ora, non devono essere stati
+// modificati dopo l'inizio
+static bool sources_unchanged(const PreCompiler *compiler, const Cache *cache)
+{
+    struct stat st;
+    if (stat(compiler->input_filename, &st) != 0 || st.st_size != cache->input_size ||
+        !same_time(st.st_mtim, cache->input_mtime))
+        return false;
+    for (int i = 0; i < compiler->stats.files_included; i++)
+    {
+        if (modified_since(compiler->included_files[i]->filename, cache->started))
+            return false;
+    }
+    return true;
+}
+
+// Crea la directory se non esiste
+static bool ensure_directory(const char *path)
+{
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+// Scrive una voce su un file temporaneo nella stessa directory e la pubblica
+// con rename(): un lettore concorrente vede la voce completa o non la vede
+static bool publish_entry(const char *dir, const char *key, const char *suffix,
+                          int (*write_entry)(FILE *, const PreCompiler *, const Cache *),
+                          const PreCompiler *compiler, const Cache *cache)
+{
+    size_t len = strlen(dir) + 4;
+    char *subdir = (char *)malloc(len);
+    char *path = entry_path(dir, key, suffix);
+    char *temp_path = path ? (char *)malloc(strlen(path) + 8) : NULL;
+    bool ok = subdir && path && temp_path;
+    if (ok)
+    {
+        snprintf(subdir, len, "%s/%.2s", dir, key);
+        snprintf(temp_path, strlen(path) + 8, "%s.XXXXXX", path);
+        ok = ensure_directory(subdir);
+    }
+
+    int fd = ok ? mkstemp(temp_path) : -1;
+    FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!file)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(temp_path);
+        }
+        ok = false;
+    }
+    else
+    {
+        fchmod(fd, 0644);
+        ok = write_entry(file, compiler, cache) == 0;
+        if (fclose(file) != 0)
+            ok = false;
+        if (ok && rename(temp_path, path) != 0)
+            ok = false;
+        if (!ok)
+            unlink(temp_path);
+    }
+
+    free(subdir);
+    free(path);
+    free(temp_path);
+    return ok;
+}
+
+static int write_manifest(FILE *file, const PreCompiler *compiler, const Cache *cache)
+{
+    (void)cache;
+    fprintf(file, "%s\nfiles %d\n", CACHE_FORMAT, compiler->stats.files_included);
+    for (int i = 0; i < compiler->stats.files_included; i++)
+    {
+        const char *name = compiler->included_files[i]->filename;
+        fprintf(file, "%zu %s\n", strlen(name), name);
+    }
+    return ferror(file) ? 1 : 0;
+}
+
+static int write_result(FILE *file, const PreCompiler *compiler, const Cache *cache)
+{
+    const Stats *stats = &compiler->stats;
+    fprintf(file, "%s\nstats %d %d %d %d %d %d %d %d\n", CACHE_FORMAT, stats->checked_vars, stats->errors_detected,
+            stats->comment_lines_deleted, stats->files_included, stats->input_lines, stats->input_size,
+            stats->output_lines, stats->output_size);
+    for (int i = 0; i < stats->files_included; i++)
+    {
+        const IncludedFile *entry = compiler->included_files[i];
+        fprintf(file, "%d %d %d %d %d %d %zu %s\n", entry->size, entry->lines, entry->requests,
+                entry->stripped_size, entry->depth, entry->parent, strlen(entry->filename), entry->filename);
+    }
+    fprintf(file, "errors %d\n", cache->error_count);
+    for (int i = 0; i < cache->error_count; i++)
+    {
+        const CachedError *error = &cache->errors[i];
+        fprintf(file, "%d %zu %s\n", error->line_number, strlen(error->var_name), error->var_name);
+    }
+    fprintf(file, "warnings %d\n", cache->warning_count);
+    for (int i = 0; i < cache->warning_count; i++)
+        fprintf(file, "%zu %s\n", strlen(cache->warnings[i]), cache->warnings[i]);
+    fprintf(file, "output %zu\n", cache->capture.len);
+    if (cache->capture.len > 0)
+        fwrite(cache->capture.data, 1, cache->capture.len, file);
+    return ferror(file) ? 1 : 0;
+}
+
+// Voce della cache considerata dallo sfratto
+typedef struct
+{
+    char *path;
+    off_t size;
+    struct timespec mtime;
+} CacheEntry;
+
+static int compare_entry_age(const void *a, const void *b)
+{
+    const CacheEntry *ea = (const CacheEntry *)a;
+    const CacheEntry *eb = (const CacheEntry *)b;
+    if (ea->mtime.tv_sec != eb->mtime.tv_sec)
+        return ea->mtime.tv_sec < eb->mtime.tv_sec ? -1 : 1;
+    if (ea->mtime.tv_nsec != eb->mtime.tv_nsec)
+        return ea->mtime.tv_nsec < eb->mtime.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Aggiunge all'elenco le voci di una sottodirectory
+static void collect_entries(const char *subdir, CacheEntry **entries, int *count, int *capacity, long long *total)
+{
+    DIR *dir = opendir(subdir);
+    if (!dir)
+        return;
+
+    struct dirent *item;
+    while ((item = readdir(dir)) != NULL)
+    {
+        const char *dot = strrchr(item->d_name, '.');
+        if (!dot || (strcmp(dot, ".result") != 0 && strcmp(dot, ".manifest") != 0))
+            continue;
+
+        size_t len = strlen(subdir) + strlen(item->d_name) + 2;
+        char *path = (char *)malloc(len);
+        struct stat st;
+        if (!path)
+            break;
+        snprintf(path, len, "%s/%s", subdir, item->d_name);
+        if (stat(path, &st) != 0)
+        {
+            free(path);
+            continue;
+        }
+
+        if (*count == *capacity)
+        {
+            int new_capacity = *capacity ? *capacity * 2 : 256;
+            CacheEntry *new_entries = (CacheEntry *)realloc(*entries, new_capacity * sizeof(CacheEntry));
+            if (!new_entries)
+            {
+                free(path);
+                break;
+            }
+            *entries = new_entries;
+            *capacity = new_capacity;
+        }
+        (*entries)[*count].path = path;
+        (*entries)[*count].size = st.st_size;
+        (*entries)[*count].mtime = st.st_mtim;
+        (*count)++;
+        *total += st.st_size;
+    }
+    closedir(dir);
+}
+
+// Elimina le voci usate meno di recente finché la cache supera la dimensione
+// massima. Un solo processo alla volta esegue lo sfratto: gli altri lo saltano.
+static void evict_entries(const PreCompiler *compiler)
+{
+    const char *cache_dir = compiler->cache_dir;
+    size_t len = strlen(cache_dir) + 6;
+    char *lock_path = (char *)malloc(len);
+    if (!lock_path)
+        return;
+    snprintf(lock_path, len, "%s/lock", cache_dir);
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0666);
+    free(lock_path);
+    if (lock_fd < 0)
+        return;
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(lock_fd);
+        return;
+    }
+
+    CacheEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    long long total = 0;
+    DIR *dir = opendir(cache_dir);
+    if (dir)
+    {
+        struct dirent *item;
+        char subdir[PATH_MAX];
+        while ((item = readdir(dir)) != NULL)
+        {
+            if (strlen(item->d_name) != 2 || !isxdigit((unsigned char)item->d_name[0]) ||
+                !isxdigit((unsigned char)item->d_name[1]))
+                continue;
+            snprintf(subdir, sizeof(subdir), "%s/%s", cache_dir, item->d_name);
+            collect_entries(subdir, &entries, &count, &capacity, &total);
+        }
+        closedir(dir);
+    }
+
+    if (total > compiler->cache_max_bytes)
+    {
+        long long target = compiler->cache_max_bytes / 100 * CACHE_EVICT_PERCENT;
+        qsort(entries, count, sizeof(CacheEntry), compare_entry_age);
+        for (int i = 0; i < count && total > target; i++)
+        {
+            // Una voce già rimossa da un altro processo non conta più
+            if (unlink(entries[i].path) == 0 || errno == ENOENT)
+                total -= entries[i].size;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        free(entries[i].path);
+    free(entries);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+}
+
+// Salva il risultato di un'elaborazione completata
+void cache_store(PreCompiler *compiler)
+{
+    Cache *cache = compiler->cache;
+
+    // Un #include non trovato potrebbe esistere alla prossima esecuzione:
+    // il risultato non dipende solo dai file elencati nel manifest
+    if (!cache || cache->failed || cache->capture.failed || compiler->aborted || compiler->missing_includes > 0)
+        return;
+
+    // Un file modificato durante l'elaborazione renderebbe la chiave diversa
+    // dal testo elaborato: il risultato non viene salvato
+    if (!sources_unchanged(compiler, cache))
+        return;
+
+    trace_begin("stage", "cache");
+    char **names = NULL;
+    int count = compiler->stats.files_included;
+    if (count > 0)
+    {
+        names = (char **)malloc(count * sizeof(char *));
+        if (!names)
+        {
+            trace_end();
+            return;
+        }
+        for (int i = 0; i < count; i++)
+            names[i] = compiler->included_files[i]->filename;
+    }
+
+    char result_key[33];
+    if (ensure_directory(compiler->cache_dir) && compute_result_key(cache->input_key, names, count, result_key) &&
+        publish_entry(compiler->cache_dir, result_key, ".result", write_result, compiler, cache))
+    {
+        // Il manifest viene pubblicato dopo il risultato a cui conduce
+        if (publish_entry(compiler->cache_dir, cache->input_key, ".manifest", write_manifest, compiler, cache))
+            evict_entries(compiler);
+    }
+    else
+    {
+        fprintf(stderr, "Avviso: impossibile salvare il risultato nella cache %s\n", compiler->cache_dir);
+    }
+    free(names);
+    trace_end();
+}
+
+// Libera lo stato della cache
+void cache_free(Cache *cache)
+{
+    if (!cache)
+        return;
+    for (int i = 0; i < cache->error_count; i++)
+        free(cache->errors[i].var_name);
+    free(cache->errors);
+    for (int i = 0; i < cache->warning_count; i++)
+        free(cache->warnings[i]);
+    free(cache->warnings);
+    free(cache->capture.data);
+    free(cache);
+}
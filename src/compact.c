@@ -0,0 +1,120 @@
+#include "../include/precompiler.h"
+
+// Inizializza lo stato della compattazione
+void compactor_init(Compactor *compactor)
+{
+    memset(compactor, 0, sizeof(Compactor));
+    compactor->line = 1;
+    line_directive_reset(&compactor->directive);
+}
+
+// Libera la memoria della compattazione
+void compactor_free(Compactor *compactor)
+{
+    free(compactor->spaces);
+    compactor->spaces = NULL;
+    compactor->space_len = 0;
+    compactor->space_capacity = 0;
+}
+
+// Aggiunge uno spazio a quelli in sospeso; restituisce false se la memoria è esaurita
+static bool push_space(Compactor *compactor, char c)
+{
+    if (compactor->space_len == compactor->space_capacity)
+    {
+        size_t new_capacity = compactor->space_capacity ? compactor->space_capacity * 2 : 64;
+        char *spaces = (char *)realloc(compactor->spaces, new_capacity);
+        if (!spaces)
+            return false;
+        compactor->spaces = spaces;
+        compactor->space_capacity = new_capacity;
+    }
+    compactor->spaces[compactor->space_len++] = c;
+    return true;
+}
+
+// Emette le righe vuote in sospeso prima della riga corrente, che contiene testo.
+// Un marcatore #line sostituisce la sequenza solo se occupa meno byte: così
+// l'output non supera mai l'input già consumato.
+static size_t flush_blank_lines(Compactor *compactor, char *output)
+{
+    size_t out_len = 0;
+    if (compactor->blank_lines == 0)
+        return 0;
+
+    char marker[24];
+    int marker_len = snprintf(marker, sizeof(marker), "#line %d\n", compactor->line);
+    if ((size_t)marker_len < compactor->blank_bytes)
+    {
+        memcpy(output, marker, marker_len);
+        out_len = marker_len;
+    }
+    else
+    {
+        memset(output, '\n', compactor->blank_lines);
+        out_len = compactor->blank_lines;
+    }
+    compactor->blank_lines = 0;
+    compactor->blank_bytes = 0;
+    return out_len;
+}
+
+// Compatta un blocco di testo privo di commenti
+size_t compact_lines(Compactor *compactor, const char *input, size_t len, char *output)
+{
+    size_t out_len = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = input[i];
+        if (c == '\n')
+        {
+            // Gli spazi in sospeso sono a fine riga e vengono scartati. Una riga
+            // vuota che prosegue una direttiva con '\' la termina: resta al suo posto.
+            if (compactor->line_has_text || compactor->continued)
+            {
+                output[out_len++] = '\n';
+            }
+            else
+            {
+                compactor->blank_lines++;
+                compactor->blank_bytes += compactor->space_len + 1;
+            }
+            compactor->continued = compactor->line_has_text && compactor->last == '\\';
+
+            // Una direttiva #line dell'input cambia la numerazione delle righe successive
+            int line = line_directive_value(&compactor->directive);
+            compactor->line = line > 0 ? line : compactor->line + 1;
+            line_directive_reset(&compactor->directive);
+            compactor->space_len = 0;
+            compactor->line_has_text = false;
+            continue;
+        }
+
+        line_directive_feed(&compactor->directive, (unsigned char)c);
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v')
+        {
+            if (push_space(compactor, c))
+                continue;
+            // Memoria esaurita: la riga viene trattata come testo
+        }
+
+        if (!compactor->line_has_text)
+        {
+            out_len += flush_blank_lines(compactor, output + out_len);
+            compactor->line_has_text = true;
+        }
+        memcpy(output + out_len, compactor->spaces, compactor->space_len);
+        out_len += compactor->space_len;
+        compactor->space_len = 0;
+        output[out_len++] = c;
+        compactor->last = c;
+    }
+    return out_len;
+}
+
+// Byte che compact_lines può scrivere compattando un blocco di len byte: il
+// blocco, gli spazi in sospeso e le righe vuote o il marcatore dei blocchi precedenti
+size_t compact_capacity(const Compactor *compactor, size_t len)
+{
+    return len + compactor->space_len + COMPACT_SLACK;
+}
@@ -0,0 +1,338 @@
+#include "../include/compression.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Dimensione dei blocchi letti e prodotti in streaming
+#define CODEC_CHUNK_SIZE (64 * 1024)
+
+struct Encoder {
+    Codec codec;               // Formato di compressione
+#ifdef HAVE_ZLIB
+    z_stream gzip;             // Stato del compressore gzip
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* zstd;           // Stato del compressore zstd
+#endif
+    char out[CODEC_CHUNK_SIZE];// Buffer per l'output compresso
+};
+
+// Riconosce il formato di compressione dall'estensione del file
+Codec codec_from_filename(const char *filename)
+{
+    size_t len = filename ? strlen(filename) : 0;
+    if (len > 3 && strcmp(filename + len - 3, ".gz") == 0)
+        return CODEC_GZIP;
+    if (len > 4 && strcmp(filename + len - 4, ".zst") == 0)
+        return CODEC_ZSTD;
+    return CODEC_NONE;
+}
+
+// Restituisce il nome leggibile del formato
+const char *codec_name(Codec codec)
+{
+    switch (codec)
+    {
+    case CODEC_GZIP:
+        return "gzip";
+    case CODEC_ZSTD:
+        return "zstd";
+    default:
+        return "nessuno";
+    }
+}
+
+// Garantisce che il buffer di output possa contenere almeno needed byte
+static bool reserve(char **buffer, size_t *capacity, size_t needed)
+{
+    if (needed <= *capacity)
+        return true;
+    size_t new_capacity = *capacity * 2;
+    if (new_capacity < needed)
+        new_capacity = needed;
+    char *new_buffer = (char *)realloc(*buffer, new_capacity);
+    if (!new_buffer)
+        return false;
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return true;
+}
+
+#ifdef HAVE_ZLIB
+// Decomprime un file gzip (anche con più membri concatenati)
+static char *read_gzip(FILE *file, const char *filename, size_t *size)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)
+    {
+        fprintf(stderr, "Errore: impossibile inizializzare la decompressione di %s\n", filename);
+        return NULL;
+    }
+
+    unsigned char *in = (unsigned char *)malloc(CODEC_CHUNK_SIZE);
+    size_t capacity = CODEC_CHUNK_SIZE * 4;
+    char *content = (char *)malloc(capacity);
+    size_t len = 0;
+    bool finished = false;
+    bool failed = !in || !content;
+
+    while (!failed)
+    {
+        if (stream.avail_in == 0)
+        {
+            size_t read_size = fread(in, 1, CODEC_CHUNK_SIZE, file);
+            if (read_size == 0)
+                break;
+            stream.next_in = in;
+            stream.avail_in = (uInt)read_size;
+        }
+        if (!reserve(&content, &capacity, len + CODEC_CHUNK_SIZE + 1))
+        {
+            failed = true;
+            break;
+        }
+
+        uInt available = (uInt)(capacity - len - 1);
+        stream.next_out = (Bytef *)content + len;
+        stream.avail_out = available;
+        int ret = inflate(&stream, Z_NO_FLUSH);
+        len += available - stream.avail_out;
+
+        if (ret == Z_STREAM_END)
+        {
+            // Un membro è terminato: può seguirne un altro
+            finished = true;
+            inflateReset(&stream);
+        }
+        else if (ret == Z_OK)
+        {
+            finished = false;
+        }
+        else if (ret != Z_BUF_ERROR)
+        {
+            failed = true;
+        }
+    }
+
+    inflateEnd(&stream);
+    free(in);
+    if (failed || !finished)
+    {
+        fprintf(stderr, "Errore: file gzip non valido o troncato %s\n", filename);
+        free(content);
+        return NULL;
+    }
+    content[len] = '\0';
+    *size = len;
+    return content;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+// Decomprime un file zstd (anche con più frame concatenati)
+static char *read_zstd(FILE *file, const char *filename, size_t *size)
+{
+    ZSTD_DCtx *context = ZSTD_createDCtx();
+    char *in = (char *)malloc(CODEC_CHUNK_SIZE);
+    size_t capacity = CODEC_CHUNK_SIZE * 4;
+    char *content = (char *)malloc(capacity);
+    size_t len = 0;
+    size_t pending = 0;
+    bool failed = !context || !in || !content;
+
+    ZSTD_inBuffer input = {in, 0, 0};
+    while (!failed)
+    {
+        if (input.pos == input.size)
+        {
+            size_t read_size = fread(in, 1, CODEC_CHUNK_SIZE, file);
+            if (read_size == 0)
+                break;
+            input.size = read_size;
+            input.pos = 0;
+        }
+        if (!reserve(&content, &capacity, len + CODEC_CHUNK_SIZE + 1))
+        {
+            failed = true;
+            break;
+        }
+
+        ZSTD_outBuffer output = {content + len, capacity - len - 1, 0};
+        pending = ZSTD_decompressStream(context, &output, &input);
+        len += output.pos;
+        if (ZSTD_isError(pending))
+            failed = true;
+    }
+
+    ZSTD_freeDCtx(context);
+    free(in);
+    if (failed || pending != 0)
+    {
+        fprintf(stderr, "Errore: file zstd non valido o troncato %s\n", filename);
+        free(content);
+        return NULL;
+    }
+    content[len] = '\0';
+    *size = len;
+    return content;
+}
+#endif
+
+// Legge e decomprime in streaming un file compresso; restituisce un buffer terminato da zero
+char *read_compressed_file(const char *filename, Codec codec, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Errore: impossibile aprire il file %s\n", filename);
+        return NULL;
+    }
+
+    char *content = NULL;
+    switch (codec)
+    {
+#ifdef HAVE_ZLIB
+    case CODEC_GZIP:
+        content = read_gzip(file, filename, size);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+        content = read_zstd(file, filename, size);
+        break;
+#endif
+    default:
+        fprintf(stderr, "Errore: supporto %s non disponibile in questa build per %s\n", codec_name(codec), filename);
+        break;
+    }
+
+    fclose(file);
+    return content;
+}
+
+// Crea un compressore in streaming per il formato indicato
+Encoder *encoder_open(Codec codec)
+{
+    Encoder *encoder = (Encoder *)calloc(1, sizeof(Encoder));
+    if (!encoder)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il compressore\n");
+        return NULL;
+    }
+    encoder->codec = codec;
+
+    switch (codec)
+    {
+#ifdef HAVE_ZLIB
+    case CODEC_GZIP:
+        if (deflateInit2(&encoder->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+            return encoder;
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+        encoder->zstd = ZSTD_createCCtx();
+        if (encoder->zstd)
+            return encoder;
+        break;
+#endif
+    default:
+        fprintf(stderr, "Errore: supporto %s non disponibile in questa build\n", codec_name(codec));
+        free(encoder);
+        return NULL;
+    }
+
+    fprintf(stderr, "Errore: impossibile inizializzare il compressore %s\n", codec_name(codec));
+    free(encoder);
+    return NULL;
+}
+
+// Comprime un blocco (o chiude lo stream se finish) passando l'output a emit
+static int encoder_run(Encoder *encoder, const char *data, size_t len, bool finish, EncoderEmit emit, void *context)
+{
+    switch (encoder->codec)
+    {
+#ifdef HAVE_ZLIB
+    case CODEC_GZIP:
+    {
+        z_stream *stream = &encoder->gzip;
+        stream->next_in = (Bytef *)data;
+        stream->avail_in = (uInt)len;
+        int ret;
+        do
+        {
+            stream->next_out = (Bytef *)encoder->out;
+            stream->avail_out = CODEC_CHUNK_SIZE;
+            ret = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (ret == Z_STREAM_ERROR)
+                return 1;
+            size_t produced = CODEC_CHUNK_SIZE - stream->avail_out;
+            if (produced > 0 && emit(context, encoder->out, produced) != 0)
+                return 1;
+        } while (stream->avail_out == 0 || (finish && ret != Z_STREAM_END));
+        return 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+    {
+        ZSTD_inBuffer input = {data, len, 0};
+        size_t remaining;
+        do
+        {
+            ZSTD_outBuffer output = {encoder->out, CODEC_CHUNK_SIZE, 0};
+            remaining = ZSTD_compressStream2(encoder->zstd, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining))
+                return 1;
+            if (output.pos > 0 && emit(context, encoder->out, output.pos) != 0)
+                return 1;
+        } while (finish ? remaining != 0 : input.pos < input.size);
+        return 0;
+    }
+#endif
+    default:
+        (void)data;
+        (void)len;
+        (void)finish;
+        (void)emit;
+        (void)context;
+        return 1;
+    }
+}
+
+// Comprime un blocco e passa l'output compresso a emit
+int encoder_write(Encoder *encoder, const char *data, size_t len, EncoderEmit emit, void *context)
+{
+    return encoder_run(encoder, data, len, false, emit, context);
+}
+
+// Chiude lo stream compresso emettendo i dati rimasti
+int encoder_finish(Encoder *encoder, EncoderEmit emit, void *context)
+{
+    return encoder_run(encoder, NULL, 0, true, emit, context);
+}
+
+// Libera il compressore
+void encoder_free(Encoder *encoder)
+{
+    if (!encoder)
+        return;
+#ifdef HAVE_ZLIB
+    if (encoder->codec == CODEC_GZIP)
+        deflateEnd(&encoder->gzip);
+#endif
+#ifdef HAVE_ZSTD
+    if (encoder->codec == CODEC_ZSTD)
+        ZSTD_freeCCtx(encoder->zstd);
+#endif
+    free(encoder);
+}
@@ -0,0 +1,784 @@
+#include "../include/declarations.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+// Stati del parser delle dichiarazioni
+enum
+{
+    ST_STMT,      // Inizio di un'istruzione o di una dichiarazione
+    ST_PARAM,     // Inizio di un parametro
+    ST_WORD,      // Lettura di una parola (parola chiave, tipo o nome)
+    ST_SPEC,      // Dentro gli specificatori di tipo
+    ST_TAG,       // Dopo struct/union/enum, in attesa del tag
+    ST_TAG_AFTER, // Dopo il tag, in attesa del corpo o del dichiaratore
+    ST_DECL,      // In attesa di un dichiaratore (puntatori, raggruppamenti, nome)
+    ST_NAME,      // Lettura del nome dichiarato
+    ST_AFTER,     // Dopo il nome: array, parametri, inizializzatore, separatori
+    ST_INIT,      // Dentro un inizializzatore o la larghezza di un campo di bit
+    ST_EXPR,      // Dentro un'istruzione che non è una dichiarazione
+    ST_FOR,       // Dopo la parola chiave for
+    ST_SKIP,      // Dentro parentesi da saltare
+    ST_IDENT,     // Dopo un identificatore sconosciuto a inizio istruzione
+    ST_IDENT_STAR // Dopo "identificatore *" a inizio istruzione
+};
+
+// Stati lessicali
+enum
+{
+    LEX_CODE,
+    LEX_STRING,
+    LEX_STRING_ESCAPE,
+    LEX_CHAR,
+    LEX_CHAR_ESCAPE,
+    LEX_DIRECTIVE,
+    LEX_DIRECTIVE_ESCAPE
+};
+
+// Stati del riconoscimento di #line
+enum
+{
+    LD_START,     // Spazi a inizio riga
+    LD_HASH,      // Dopo '#', spazi prima della parola chiave o del numero
+    LD_KEYWORD,   // Dentro "line" (value conta le lettere lette)
+    LD_SPACE,     // Spazi tra "line" e il numero
+    LD_DIGITS,    // Dentro il numero
+    LD_MATCHED,   // Numero completo: il resto della riga (nome del file) è ignorato
+    LD_FAILED     // La riga non è una direttiva #line
+};
+
+// Classi delle parole chiave rilevanti per le dichiarazioni
+enum
+{
+    KW_NONE,
+    KW_TYPE,      // Specificatore di tipo
+    KW_QUALIFIER, // Qualificatore o classe di memorizzazione
+    KW_STRUCT,    // struct o union
+    KW_ENUM,      // enum
+    KW_FOR,       // for
+    KW_STATEMENT  // Parola chiave che inizia un'istruzione non dichiarativa
+};
+
+static const struct
+{
+    const char *word;
+    unsigned char kind;
+} keywords[] = {
+    {"void", KW_TYPE},
+    {"char", KW_TYPE},
+    {"short", KW_TYPE},
+    {"int", KW_TYPE},
+    {"long", KW_TYPE},
+    {"float", KW_TYPE},
+    {"double", KW_TYPE},
+    {"signed", KW_TYPE},
+    {"unsigned", KW_TYPE},
+    {"_Bool", KW_TYPE},
+    {"bool", KW_TYPE},
+    {"_Complex", KW_TYPE},
+    {"__int128", KW_TYPE},
+    {"const", KW_QUALIFIER},
+    {"volatile", KW_QUALIFIER},
+    {"restrict", KW_QUALIFIER},
+    {"static", KW_QUALIFIER},
+    {"extern", KW_QUALIFIER},
+    {"register", KW_QUALIFIER},
+    {"typedef", KW_QUALIFIER},
+    {"inline", KW_QUALIFIER},
+    {"auto", KW_QUALIFIER},
+    {"_Atomic", KW_QUALIFIER},
+    {"_Thread_local", KW_QUALIFIER},
+    {"thread_local", KW_QUALIFIER},
+    {"__thread", KW_QUALIFIER},
+    {"_Noreturn", KW_QUALIFIER},
+    {"struct", KW_STRUCT},
+    {"union", KW_STRUCT},
+    {"enum", KW_ENUM},
+    {"for", KW_FOR},
+    {"return", KW_STATEMENT},
+    {"goto", KW_STATEMENT},
+    {"case", KW_STATEMENT},
+    {"default", KW_STATEMENT},
+    {"else", KW_STATEMENT},
+    {"do", KW_STATEMENT},
+    {"if", KW_STATEMENT},
+    {"while", KW_STATEMENT},
+    {"switch", KW_STATEMENT},
+    {"break", KW_STATEMENT},
+    {"continue", KW_STATEMENT},
+    {"sizeof", KW_STATEMENT},
+};
+
+// Restituisce la classe della parola corrente
+static unsigned char keyword_kind(const DeclScanner *s)
+{
+    if (s->name_overflow)
+        return KW_NONE;
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+    {
+        if (strlen(keywords[i].word) == s->word_len && memcmp(keywords[i].word, s->word, s->word_len) == 0)
+            return keywords[i].kind;
+    }
+    return KW_NONE;
+}
+
+// Caratteri che possono far parte di una parola (compresi i byte UTF-8)
+static bool is_word_char(unsigned char c)
+{
+    return isalnum(c) || c == '_' || c >= 0x80;
+}
+
+// Caratteri che terminano il nome di un dichiaratore
+static bool is_name_terminator(unsigned char c)
+{
+    return c == ',' || c == ';' || c == '=' || c == '(' || c == ')' || c == '[' ||
+           c == ']' || c == '{' || c == '}' || c == ':' || c == '\n';
+}
+
+// Stato iniziale all'interno di un nuovo contesto
+static unsigned char initial_state(DeclFrameKind kind)
+{
+    switch (kind)
+    {
+    case DECL_FRAME_PARAMS:
+        return ST_PARAM;
+    case DECL_FRAME_ENUM:
+    case DECL_FRAME_SKIP:
+        return ST_SKIP;
+    default:
+        return ST_STMT;
+    }
+}
+
+// Apre un contesto annidato, salvando lo stato da ripristinare alla chiusura
+static void push_frame(DeclScanner *s, DeclFrameKind kind, unsigned char resume)
+{
+    if (s->depth == s->capacity)
+    {
+        int new_capacity = s->capacity ? s->capacity * 2 : 16;
+        DeclFrame *frames = (DeclFrame *)realloc(s->frames, new_capacity * sizeof(DeclFrame));
+        if (!frames)
+        {
+            // Senza memoria si continua senza tracciare il contesto
+            s->state = initial_state(kind);
+            return;
+        }
+        s->frames = frames;
+        s->capacity = new_capacity;
+    }
+
+    DeclFrame *frame = &s->frames[s->depth++];
+    frame->kind = (unsigned char)kind;
+    frame->resume = resume;
+    frame->have_type = s->have_type;
+    frame->decl_paren = s->decl_paren;
+
+    s->have_type = false;
+    s->decl_paren = 0;
+    s->state = initial_state(kind);
+}
+
+// Chiude il contesto corrente ripristinando lo stato esterno
+static void pop_frame(DeclScanner *s)
+{
+    if (s->depth == 0)
+    {
+        // Parentesi di chiusura senza apertura: si riparte da un'istruzione
+        s->state = ST_STMT;
+        s->have_type = false;
+        s->decl_paren = 0;
+        return;
+    }
+
+    DeclFrame *frame = &s->frames[--s->depth];
+    s->state = frame->resume;
+    s->have_type = frame->have_type;
+    s->decl_paren = frame->decl_paren;
+    if (s->state == ST_STMT)
+    {
+        s->have_type = false;
+        s->decl_paren = 0;
+    }
+}
+
+// Vero se il contesto corrente è una lista di parametri
+static bool in_params(const DeclScanner *s)
+{
+    return s->depth > 0 && s->frames[s->depth - 1].kind == DECL_FRAME_PARAMS;
+}
+
+// Passa al dichiaratore successivo dopo una virgola
+static void next_declarator(DeclScanner *s)
+{
+    s->decl_paren = 0;
+    if (in_params(s))
+    {
+        s->state = ST_PARAM;
+        s->have_type = false;
+    }
+    else
+    {
+        s->state = ST_DECL;
+    }
+}
+
+// Termina la dichiarazione corrente
+static void end_declaration(DeclScanner *s)
+{
+    s->state = ST_STMT;
+    s->have_type = false;
+    s->decl_paren = 0;
+}
+
+static void start_word(DeclScanner *s, unsigned char c, unsigned char context)
+{
+    s->word[0] = (char)c;
+    s->word_len = 1;
+    s->name_overflow = false;
+    s->name_line = s->line_number;
+    s->word_context = context;
+    s->state = ST_WORD;
+}
+
+static void start_name(DeclScanner *s, unsigned char c)
+{
+    s->name[0] = (char)c;
+    s->name_len = 1;
+    s->name_overflow = false;
+    s->name_line = s->line_number;
+    s->state = ST_NAME;
+}
+
+// La parola appena letta è l'inizio del nome del dichiaratore
+static void name_from_word(DeclScanner *s)
+{
+    memcpy(s->name, s->word, s->word_len);
+    s->name_len = s->word_len;
+    s->state = ST_NAME;
+}
+
+// Invia il nome letto alla callback, senza gli spazi finali
+static void report_name(DeclScanner *s)
+{
+    while (s->name_len > 0 && isspace((unsigned char)s->name[s->name_len - 1]))
+        s->name_len--;
+    if (s->name_len == 0 || s->name_overflow)
+        return;
+
+    s->name[s->name_len] = '\0';
+    if (!s->report(s->context, s->name, s->name_line))
+        s->stopped = true;
+}
+
+// Decide il significato della parola appena terminata e restituisce il nuovo stato
+static unsigned char classify_word(DeclScanner *s)
+{
+    unsigned char kind = keyword_kind(s);
+
+    switch (s->word_context)
+    {
+    case ST_TAG:
+        return ST_TAG_AFTER;
+
+    case ST_DECL:
+        if (kind == KW_QUALIFIER)
+            return ST_DECL;
+        name_from_word(s);
+        return ST_NAME;
+
+    default:
+        break;
+    }
+
+    // Contesti ST_STMT, ST_PARAM e ST_SPEC
+    switch (kind)
+    {
+    case KW_TYPE:
+        s->have_type = true;
+        return ST_SPEC;
+    case KW_QUALIFIER:
+        return ST_SPEC;
+    case KW_STRUCT:
+    case KW_ENUM:
+        s->have_type = true;
+        s->tag_kind = kind == KW_ENUM ? DECL_FRAME_ENUM : DECL_FRAME_STRUCT;
+        return ST_TAG;
+    case KW_FOR:
+        if (s->word_context == ST_STMT)
+            return ST_FOR;
+        break;
+    default:
+        break;
+    }
+
+    if (s->word_context == ST_STMT)
+    {
+        // Un identificatore sconosciuto può essere un tipo definito con typedef:
+        // lo decide il simbolo che segue
+        return kind == KW_STATEMENT ? ST_EXPR : ST_IDENT;
+    }
+    if (!s->have_type)
+    {
+        // Primo identificatore sconosciuto: è un nome di tipo definito con typedef
+        s->have_type = true;
+        return ST_SPEC;
+    }
+    name_from_word(s);
+    return ST_NAME;
+}
+
+// Prepara il riconoscimento per una nuova riga
+void line_directive_reset(LineDirective *directive)
+{
+    directive->state = LD_START;
+    directive->value = 0;
+}
+
+// Esamina il byte successivo della riga
+void line_directive_feed(LineDirective *directive, unsigned char c)
+{
+    bool blank = c == ' ' || c == '\t';
+    switch (directive->state)
+    {
+    case LD_START:
+        if (c == '#')
+            directive->state = LD_HASH;
+        else if (!blank)
+            directive->state = LD_FAILED;
+        break;
+    case LD_HASH:
+        if (isdigit(c))
+        {
+            directive->state = LD_DIGITS;
+            directive->value = c - '0';
+        }
+        else if (c == 'l')
+        {
+            directive->state = LD_KEYWORD;
+            directive->value = 1;
+        }
+        else if (!blank)
+            directive->state = LD_FAILED;
+        break;
+    case LD_KEYWORD:
+        if (directive->value < 4 && c == (unsigned char)"line"[directive->value])
+        {
+            directive->value++;
+        }
+        else if (directive->value == 4 && blank)
+        {
+            directive->state = LD_SPACE;
+            directive->value = 0;
+        }
+        else
+            directive->state = LD_FAILED;
+        break;
+    case LD_SPACE:
+        if (isdigit(c))
+        {
+            directive->state = LD_DIGITS;
+            directive->value = c - '0';
+        }
+        else if (!blank)
+            directive->state = LD_FAILED;
+        break;
+    case LD_DIGITS:
+        if (isdigit(c) && directive->value <= (INT_MAX - (c - '0')) / 10)
+            directive->value = directive->value * 10 + (c - '0');
+        else if (blank)
+            directive->state = LD_MATCHED;
+        else
+            directive->state = LD_FAILED;
+        break;
+    default:
+        break;
+    }
+}
+
+// Numero indicato dalla direttiva (0 se la riga non è una direttiva #line)
+int line_directive_value(const LineDirective *directive)
+{
+    return directive->state == LD_DIGITS || directive->state == LD_MATCHED ? directive->value : 0;
+}
+
+// Elabora un singolo byte
+static void process_byte(DeclScanner *s, unsigned char c)
+{
+    if (c == '\n')
+        s->line_number++;
+
+    // Stringhe, caratteri letterali e direttive del preprocessore non contengono dichiarazioni
+    switch (s->lexical)
+    {
+    case LEX_STRING:
+        if (c == '\\')
+            s->lexical = LEX_STRING_ESCAPE;
+        else if (c == '"' || c == '\n')
+            s->lexical = LEX_CODE;
+        return;
+    case LEX_CHAR:
+        if (c == '\\')
+            s->lexical = LEX_CHAR_ESCAPE;
+        else if (c == '\'' || c == '\n')
+            s->lexical = LEX_CODE;
+        return;
+    case LEX_STRING_ESCAPE:
+        s->lexical = LEX_STRING;
+        return;
+    case LEX_CHAR_ESCAPE:
+        s->lexical = LEX_CHAR;
+        return;
+    case LEX_DIRECTIVE:
+        if (c == '\\')
+            s->lexical = LEX_DIRECTIVE_ESCAPE;
+        else if (c == '\n')
+        {
+            // #line N assegna il numero N alla riga successiva
+            int line = line_directive_value(&s->directive);
+            if (line > 0)
+                s->line_number = line;
+            s->lexical = LEX_CODE;
+            s->at_line_start = true;
+        }
+        if (c != '\n')
+            line_directive_feed(&s->directive, c);
+        return;
+    case LEX_DIRECTIVE_ESCAPE:
+        s->lexical = LEX_DIRECTIVE;
+        return;
+    default:
+        break;
+    }
+
+    if (c == '#' && s->at_line_start)
+    {
+        s->lexical = LEX_DIRECTIVE;
+        line_directive_reset(&s->directive);
+        line_directive_feed(&s->directive, c);
+        return;
+    }
+    if (c == '\n')
+        s->at_line_start = true;
+    else if (!isspace(c))
+        s->at_line_start = false;
+
+again:
+    if ((c == '"' || c == '\'') && s->state != ST_NAME && s->state != ST_WORD)
+    {
+        s->lexical = c == '"' ? LEX_STRING : LEX_CHAR;
+        if (s->state == ST_STMT)
+            s->state = ST_EXPR;
+        return;
+    }
+
+    switch (s->state)
+    {
+    case ST_STMT:
+        if (isspace(c) || c == ';')
+            break;
+        if (is_word_char(c))
+            start_word(s, c, ST_STMT);
+        else if (c == '{')
+            push_frame(s, DECL_FRAME_BLOCK, ST_STMT);
+        else if (c == '}' || c == ')' || c == ']')
+            pop_frame(s);
+        else if (c == '(' || c == '[')
+            push_frame(s, DECL_FRAME_SKIP, ST_EXPR);
+        else
+            s->state = ST_EXPR;
+        break;
+
+    case ST_PARAM:
+        if (isspace(c))
+            break;
+        if (is_word_char(c))
+            start_word(s, c, ST_PARAM);
+        else if (c == ',')
+            next_declarator(s);
+        else if (c == '(' || c == '[' || c == '{')
+            push_frame(s, DECL_FRAME_SKIP, ST_PARAM);
+        else if (c == ')' || c == ']' || c == '}')
+            pop_frame(s);
+        break;
+
+    case ST_WORD:
+        if (is_word_char(c))
+        {
+            if (s->word_len < DECL_NAME_MAX - 1)
+                s->word[s->word_len++] = (char)c;
+            else
+                s->name_overflow = true;
+            break;
+        }
+        s->state = classify_word(s);
+        goto again;
+
+    case ST_SPEC:
+        if (isspace(c))
+            break;
+        if (is_word_char(c))
+        {
+            start_word(s, c, ST_SPEC);
+            break;
+        }
+        if (!s->have_type)
+        {
+            s->state = ST_EXPR;
+            goto again;
+        }
+        if (c == '*' || c == '(')
+        {
+            s->state = ST_DECL;
+            goto again;
+        }
+        if (is_name_terminator(c))
+        {
+            s->state = ST_AFTER;
+            goto again;
+        }
+        start_name(s, c);
+        break;
+
+    case ST_TAG:
+    case ST_TAG_AFTER:
+        if (isspace(c))
+            break;
+        if (s->state == ST_TAG && is_word_char(c))
+        {
+            start_word(s, c, ST_TAG);
+            break;
+        }
+        if (c == '{')
+        {
+            // Il corpo di struct/union contiene dichiarazioni di membri
+            push_frame(s, (DeclFrameKind)s->tag_kind, ST_DECL);
+            break;
+        }
+        s->state = ST_SPEC;
+        goto again;
+
+    case ST_DECL:
+        if (isspace(c) || c == '*')
+            break;
+        if (c == '(')
+            s->decl_paren++;
+        else if (is_word_char(c))
+            start_word(s, c, ST_DECL);
+        else if (is_name_terminator(c))
+        {
+            s->state = ST_AFTER;
+            goto again;
+        }
+        else
+            start_name(s, c);
+        break;
+
+    case ST_NAME:
+        if (is_name_terminator(c))
+        {
+            report_name(s);
+            s->state = ST_AFTER;
+            goto again;
+        }
+        if (s->name_len < DECL_NAME_MAX - 1)
+            s->name[s->name_len++] = (char)c;
+        else
+            s->name_overflow = true;
+        break;
+
+    case ST_AFTER:
+        if (isspace(c))
+            break;
+        switch (c)
+        {
+        case '[':
+            push_frame(s, DECL_FRAME_SKIP, ST_AFTER);
+            break;
+        case '(':
+            push_frame(s, DECL_FRAME_PARAMS, ST_AFTER);
+            break;
+        case ')':
+            if (s->decl_paren > 0)
+                s->decl_paren--;
+            else
+                pop_frame(s);
+            break;
+        case '=':
+        case ':':
+            s->state = ST_INIT;
+            break;
+        case ',':
+            next_declarator(s);
+            break;
+        case ';':
+            end_declaration(s);
+            break;
+        case '{':
+            // Corpo di una funzione
+            push_frame(s, DECL_FRAME_BLOCK, ST_STMT);
+            break;
+        case '}':
+        case ']':
+            pop_frame(s);
+            break;
+        default:
+            // Attributi o altro testo dopo il dichiaratore: ignorati
+            break;
+        }
+        break;
+
+    case ST_INIT:
+        if (c == '(' || c == '[' || c == '{')
+            push_frame(s, DECL_FRAME_SKIP, ST_INIT);
+        else if (c == ')' || c == ']' || c == '}')
+            pop_frame(s);
+        else if (c == ',')
+            next_declarator(s);
+        else if (c == ';')
+            end_declaration(s);
+        break;
+
+    case ST_EXPR:
+        if (c == '(' || c == '[')
+            push_frame(s, DECL_FRAME_SKIP, ST_EXPR);
+        else if (c == '{')
+            push_frame(s, DECL_FRAME_BLOCK, ST_STMT);
+        else if (c == ')' || c == ']' || c == '}')
+            pop_frame(s);
+        else if (c == ';')
+            end_declaration(s);
+        break;
+
+    case ST_FOR:
+        if (isspace(c))
+            break;
+        if (c == '(')
+        {
+            // La prima clausola del for può essere una dichiarazione
+            push_frame(s, DECL_FRAME_FOR, ST_STMT);
+            break;
+        }
+        s->state = ST_EXPR;
+        goto again;
+
+    case ST_SKIP:
+        if (c == '(' || c == '[' || c == '{')
+            push_frame(s, DECL_FRAME_SKIP, ST_SKIP);
+        else if (c == ')' || c == ']' || c == '}')
+            pop_frame(s);
+        break;
+
+    case ST_IDENT:
+        if (isspace(c))
+            break;
+        if (is_word_char(c))
+        {
+            // "tipo nome": l'identificatore era un nome di tipo
+            s->have_type = true;
+            start_word(s, c, ST_SPEC);
+            break;
+        }
+        if (c == '*')
+        {
+            s->state = ST_IDENT_STAR;
+            break;
+        }
+        s->state = ST_EXPR;
+        goto again;
+
+    case ST_IDENT_STAR:
+        if (c == '=')
+        {
+            // "x *= ...": un'espressione
+            s->state = ST_EXPR;
+            break;
+        }
+        // "tipo *nome": dichiarazione di un puntatore
+        s->have_type = true;
+        s->state = ST_DECL;
+        goto again;
+    }
+}
+
+// Inizializza il parser
+void decl_scanner_init(DeclScanner *scanner, DeclReport report, void *context)
+{
+    memset(scanner, 0, sizeof(DeclScanner));
+    scanner->report = report;
+    scanner->context = context;
+    scanner->line_number = 1;
+    scanner->state = ST_STMT;
+    scanner->lexical = LEX_CODE;
+    scanner->at_line_start = true;
+}
+
+// Analizza un blocco di input; restituisce false se l'analisi è stata interrotta
+bool decl_scanner_feed(DeclScanner *scanner, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && !scanner->stopped; i++)
+    {
+        process_byte(scanner, (unsigned char)data[i]);
+    }
+    return !scanner->stopped;
+}
+
+// Completa l'analisi alla fine dell'input
+void decl_scanner_finish(DeclScanner *scanner)
+{
+    // Un nome ancora in lettura viene terminato come da un fine riga
+    if (!scanner->stopped && (scanner->state == ST_WORD || scanner->state == ST_NAME))
+    {
+        process_byte(scanner, '\n');
+        scanner->line_number--;
+    }
+}
+
+// Copia lo stato del parser, compresa la pila dei contesti
+int decl_scanner_copy(DeclScanner *dst, const DeclScanner *src)
+{
+    DeclFrame *frames = NULL;
+    if (src->depth > 0)
+    {
+        frames = (DeclFrame *)malloc(src->depth * sizeof(DeclFrame));
+        if (!frames)
+            return 1;
+        memcpy(frames, src->frames, src->depth * sizeof(DeclFrame));
+    }
+    *dst = *src;
+    dst->frames = frames;
+    dst->capacity = src->depth;
+    return 0;
+}
+
+// Vero se i due parser, alimentati con lo stesso testo, segnalano gli stessi nomi
+bool decl_scanner_same_state(const DeclScanner *a, const DeclScanner *b)
+{
+    if (a->state != b->state || a->word_context != b->word_context || a->lexical != b->lexical ||
+        a->tag_kind != b->tag_kind || a->at_line_start != b->at_line_start || a->have_type != b->have_type ||
+        a->decl_paren != b->decl_paren || a->stopped != b->stopped || a->name_overflow != b->name_overflow ||
+        a->word_len != b->word_len || a->name_len != b->name_len || a->depth != b->depth ||
+        a->name_line - a->line_number != b->name_line - b->line_number ||
+        a->directive.state != b->directive.state || a->directive.value != b->directive.value)
+        return false;
+    if (memcmp(a->word, b->word, a->word_len) != 0 || memcmp(a->name, b->name, a->name_len) != 0)
+        return false;
+    for (int i = 0; i < a->depth; i++)
+    {
+        const DeclFrame *fa = &a->frames[i], *fb = &b->frames[i];
+        if (fa->kind != fb->kind || fa->resume != fb->resume || fa->have_type != fb->have_type ||
+            fa->decl_paren != fb->decl_paren)
+            return false;
+    }
+    return true;
+}
+
+// Libera la memoria del parser
+void decl_scanner_free(DeclScanner *scanner)
+{
+    free(scanner->frames);
+    scanner->frames = NULL;
+    scanner->depth = 0;
+    scanner->capacity = 0;
+}
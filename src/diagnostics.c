@@ -0,0 +1,321 @@
+#include "../include/diagnostics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Dimensione del buffer di output del sink
+#define DIAG_BUFFER_SIZE (64 * 1024)
+
+// Svuota il buffer del sink sullo stream di destinazione
+static void sink_flush(DiagSink *sink)
+{
+    if (sink->buffer_len > 0 && sink->stream)
+    {
+        fwrite(sink->buffer, 1, sink->buffer_len, sink->stream);
+    }
+    sink->buffer_len = 0;
+}
+
+// Aggiunge dei byte al buffer, svuotandolo quando è pieno
+static void sink_write(DiagSink *sink, const char *data, size_t len)
+{
+    if (sink->buffer_len + len > DIAG_BUFFER_SIZE)
+    {
+        sink_flush(sink);
+        if (len > DIAG_BUFFER_SIZE)
+        {
+            fwrite(data, 1, len, sink->stream);
+            return;
+        }
+    }
+    memcpy(sink->buffer + sink->buffer_len, data, len);
+    sink->buffer_len += len;
+}
+
+// Aggiunge una stringa terminata da zero al buffer
+static void sink_puts(DiagSink *sink, const char *text)
+{
+    sink_write(sink, text, strlen(text));
+}
+
+// Scrive un carattere ripetuto nel buffer
+static void sink_fill(DiagSink *sink, char c, size_t count)
+{
+    while (count > 0)
+    {
+        if (sink->buffer_len == DIAG_BUFFER_SIZE)
+            sink_flush(sink);
+        size_t chunk = DIAG_BUFFER_SIZE - sink->buffer_len;
+        if (chunk > count)
+            chunk = count;
+        memset(sink->buffer + sink->buffer_len, c, chunk);
+        sink->buffer_len += chunk;
+        count -= chunk;
+    }
+}
+
+// Scrive del testo formattato direttamente nel buffer
+static void sink_printf(DiagSink *sink, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    size_t available = DIAG_BUFFER_SIZE - sink->buffer_len;
+    int written = vsnprintf(sink->buffer + sink->buffer_len, available, format, args);
+    va_end(args);
+    if (written < 0)
+        return;
+
+    if ((size_t)written >= available)
+    {
+        // Il testo non entra: svuota il buffer e riprova
+        sink_flush(sink);
+        va_start(args, format);
+        written = vsnprintf(sink->buffer, DIAG_BUFFER_SIZE, format, args);
+        va_end(args);
+        if (written < 0)
+            return;
+        if ((size_t)written >= DIAG_BUFFER_SIZE)
+            written = DIAG_BUFFER_SIZE - 1;
+    }
+    sink->buffer_len += written;
+}
+
+// Scrive una stringa con l'escape JSON
+static void sink_write_json_string(DiagSink *sink, const char *value)
+{
+    static const char hex[] = "0123456789abcdef";
+    sink_write(sink, "\"", 1);
+    const char *run = value;
+    for (const char *p = value; *p; p++)
+    {
+        unsigned char c = (unsigned char)*p;
+        if (c != '"' && c != '\\' && c >= 0x20)
+            continue;
+
+        sink_write(sink, run, p - run);
+        run = p + 1;
+        if (c == '"' || c == '\\')
+        {
+            char escaped[2] = {'\\', (char)c};
+            sink_write(sink, escaped, 2);
+        }
+        else
+        {
+            char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            sink_write(sink, escaped, 6);
+        }
+    }
+    sink_puts(sink, run);
+    sink_write(sink, "\"", 1);
+}
+
+// ---- Formato tabella ----
+
+// Stampa una linea di separazione della tabella
+static void table_separator(DiagSink *sink)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        sink_write(sink, "+", 1);
+        sink_fill(sink, '-', sink->widths[i]);
+    }
+    sink_write(sink, "+\n", 2);
+}
+
+// Larghezze minime delle colonne File e Variabile: la tabella viene scritta
+// man mano, quindi le colonne non possono più allargarsi dopo l'intestazione
+#define TABLE_FILE_WIDTH 24
+#define TABLE_NAME_WIDTH 32
+
+// Stampa una cella, troncando con "..." i valori più lunghi della colonna
+static void table_cell(DiagSink *sink, const char *value, size_t width)
+{
+    size_t len = strlen(value);
+    sink_write(sink, "|", 1);
+    if (len >= width)
+    {
+        size_t kept = width > 4 ? width - 4 : 0;
+        sink_write(sink, value, kept);
+        sink_write(sink, "... ", width - kept);
+        return;
+    }
+    sink_write(sink, value, len);
+    sink_fill(sink, ' ', width - len);
+}
+
+// Stampa una riga della tabella
+static void table_row(DiagSink *sink, const char *file, const char *line, const char *name)
+{
+    table_cell(sink, file, sink->widths[0]);
+    table_cell(sink, line, sink->widths[1]);
+    table_cell(sink, name, sink->widths[2]);
+    sink_write(sink, "|\n", 2);
+}
+
+static void table_finding(DiagSink *sink, const InvalidVariable *error)
+{
+    if (!sink->table_started)
+    {
+        // Le larghezze sono fissate con il primo errore; i valori più lunghi vengono troncati
+        size_t file_len = strlen(error->filename) + 2;
+        sink->widths[0] = file_len > TABLE_FILE_WIDTH ? file_len : TABLE_FILE_WIDTH;
+        sink->widths[1] = 8;
+        sink->widths[2] = TABLE_NAME_WIDTH;
+
+        sink_puts(sink, "\nDettaglio degli errori rilevati:\n");
+        table_separator(sink);
+        table_row(sink, "File", "Linea", "Variabile");
+        table_separator(sink);
+        sink->table_started = true;
+    }
+
+    char line[16];
+    snprintf(line, sizeof(line), "%d", error->line_number);
+    table_row(sink, error->filename, line, error->var_name);
+    table_separator(sink);
+}
+
+static void table_summary(DiagSink *sink, int checked_vars, int errors_detected)
+{
+    // Il riepilogo tabellare è stampato da print_stats
+    (void)sink;
+    (void)checked_vars;
+    (void)errors_detected;
+}
+
+// ---- Formato una riga per errore ----
+
+static void line_finding(DiagSink *sink, const InvalidVariable *error)
+{
+    sink_printf(sink, "%s:%d: nome di variabile non valido '%s'\n",
+                error->filename, error->line_number, error->var_name);
+}
+
+static void line_summary(DiagSink *sink, int checked_vars, int errors_detected)
+{
+    sink_printf(sink, "%d variabili controllate, %d errori rilevati%s%s\n",
+                checked_vars, errors_detected,
+                sink->limit_reached ? " (limite --max-errors raggiunto)" : "",
+                sink->interrupted ? " (elaborazione interrotta)" : "");
+}
+
+// ---- Formato JSON Lines ----
+
+static void json_finding(DiagSink *sink, const InvalidVariable *error)
+{
+    sink_puts(sink, "{\"type\":\"invalid_variable\",\"file\":");
+    sink_write_json_string(sink, error->filename);
+    sink_printf(sink, ",\"line\":%d,\"name\":", error->line_number);
+    sink_write_json_string(sink, error->var_name);
+    sink_write(sink, "}\n", 2);
+}
+
+static void json_summary(DiagSink *sink, int checked_vars, int errors_detected)
+{
+    sink_printf(sink, "{\"type\":\"summary\",\"checked_vars\":%d,\"errors\":%d,\"truncated\":%s,\"interrupted\":%s}\n",
+                checked_vars, errors_detected, sink->limit_reached ? "true" : "false",
+                sink->interrupted ? "true" : "false");
+}
+
+static const DiagFormatter formatters[] = {
+    [DIAG_FORMAT_TABLE] = {table_finding, table_summary},
+    [DIAG_FORMAT_LINE] = {line_finding, line_summary},
+    [DIAG_FORMAT_JSON] = {json_finding, json_summary},
+};
+
+// Inizializza il sink con i valori di default
+void diag_sink_init(DiagSink *sink)
+{
+    memset(sink, 0, sizeof(DiagSink));
+    sink->format = DIAG_FORMAT_TABLE;
+}
+
+// Apre lo stream di destinazione e alloca il buffer
+int diag_sink_open(DiagSink *sink)
+{
+    sink->formatter = &formatters[sink->format];
+    if (!sink->enabled)
+        return 0;
+
+    sink->buffer = (char *)malloc(DIAG_BUFFER_SIZE);
+    if (!sink->buffer)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per la diagnostica\n");
+        return 1;
+    }
+
+    if (sink->filename)
+    {
+        sink->stream = fopen(sink->filename, "w");
+        if (!sink->stream)
+        {
+            fprintf(stderr, "Errore: impossibile aprire il file di diagnostica %s\n", sink->filename);
+            free(sink->buffer);
+            sink->buffer = NULL;
+            return 1;
+        }
+    }
+    else
+    {
+        sink->stream = stderr;
+    }
+    return 0;
+}
+
+// Registra un errore; restituisce false se il limite --max-errors è stato raggiunto
+bool diag_report(DiagSink *sink, const InvalidVariable *error)
+{
+    if (sink->limit_reached)
+        return false;
+
+    sink->reported++;
+    if (sink->enabled && !sink->summary_only)
+    {
+        sink->formatter->finding(sink, error);
+    }
+
+    if (sink->max_errors > 0 && sink->reported >= sink->max_errors)
+    {
+        sink->limit_reached = true;
+        return false;
+    }
+    return true;
+}
+
+// Scrive il riepilogo finale e svuota il buffer
+void diag_sink_finish(DiagSink *sink, int checked_vars, int errors_detected)
+{
+    if (!sink->enabled || !sink->stream)
+        return;
+
+    sink->formatter->summary(sink, checked_vars, errors_detected);
+    sink_flush(sink);
+    fflush(sink->stream);
+}
+
+// Chiude lo stream e libera la memoria del sink
+void diag_sink_free(DiagSink *sink)
+{
+    if (sink->stream && sink->stream != stderr)
+        fclose(sink->stream);
+    sink->stream = NULL;
+    free(sink->buffer);
+    sink->buffer = NULL;
+    free(sink->filename);
+    sink->filename = NULL;
+}
+
+// Converte il nome di un formato nel valore corrispondente
+int diag_parse_format(const char *name, DiagFormat *format)
+{
+    if (strcmp(name, "table") == 0)
+        *format = DIAG_FORMAT_TABLE;
+    else if (strcmp(name, "line") == 0)
+        *format = DIAG_FORMAT_LINE;
+    else if (strcmp(name, "json") == 0)
+        *format = DIAG_FORMAT_JSON;
+    else
+        return 1;
+    return 0;
+}
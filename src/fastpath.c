@@ -0,0 +1,179 @@
+// copy_file_range è un'estensione GNU
+#define _GNU_SOURCE
+
+#include "../include/precompiler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+// Blocco massimo copiato da una singola chiamata di sistema
+#define FAST_PATH_CHUNK (1 << 30)
+
+// Vero se il contenuto non può essere modificato da nessun passo: senza '#'
+// non ci sono direttive, senza '/' non ci sono commenti, e senza byte nulli
+// il testo coincide con quello che vedrebbero le altre fasi
+static bool is_passthrough(const char *data, size_t size)
+{
+    return !memchr(data, '#', size) && !memchr(data, '/', size) && !memchr(data, '\0', size);
+}
+
+// Conta le righe come read_file_content
+static int count_lines(const char *data, size_t size)
+{
+    int lines = 0;
+    const char *end = data + size;
+    for (const char *p = data; (p = memchr(p, '\n', end - p)) != NULL; p++)
+        lines++;
+    if (size > 0 && data[size - 1] != '\n')
+        lines++;
+    return lines;
+}
+
+// Copia il file nel kernel: copy_file_range tra file regolari, altrimenti
+// sendfile (ad esempio verso una pipe), e come ultima risorsa write()
+static int copy_to_output(int in_fd, int out_fd, const char *data, size_t size)
+{
+    off_t offset = 0;
+    bool use_copy_range = true, use_sendfile = true;
+    while ((size_t)offset < size)
+    {
+        size_t chunk = size - offset < FAST_PATH_CHUNK ? size - offset : FAST_PATH_CHUNK;
+        ssize_t copied = -1;
+        if (use_copy_range)
+        {
+            copied = copy_file_range(in_fd, &offset, out_fd, NULL, chunk, 0);
+            if (copied < 0)
+                use_copy_range = false;
+        }
+        if (copied < 0 && use_sendfile)
+        {
+            copied = sendfile(out_fd, in_fd, &offset, chunk);
+            if (copied < 0)
+                use_sendfile = false;
+        }
+        if (copied < 0)
+        {
+            copied = write(out_fd, data + offset, chunk);
+            if (copied < 0)
+                return 1;
+            offset += copied;
+        }
+        if (copied == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Elabora senza copie in user space un input che nessun passo modificherebbe
+FastPathResult run_fast_path(PreCompiler *compiler)
+{
+    // Solo file regolari non compressi (non stdin), e output non compresso né confrontato;
+    // la compattazione modifica anche gli input senza direttive né commenti
+    if (strcmp(compiler->input_filename, "-") == 0 || compiler->compact ||
+        codec_from_filename(compiler->input_filename) != CODEC_NONE || compiler->only_if_changed ||
+        (compiler->output_filename && codec_from_filename(compiler->output_filename) != CODEC_NONE))
+        return FAST_PATH_SKIPPED;
+
+    int in_fd = open(compiler->input_filename, O_RDONLY);
+    if (in_fd < 0)
+        return FAST_PATH_SKIPPED;
+
+    struct stat st, out_st;
+    if (fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > INT_MAX)
+    {
+        close(in_fd);
+        return FAST_PATH_SKIPPED;
+    }
+
+    // Se l'output coincide con l'input, troncarlo cancellerebbe i dati da copiare
+    if (compiler->output_filename && stat(compiler->output_filename, &out_st) == 0 &&
+        out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino)
+    {
+        close(in_fd);
+        return FAST_PATH_SKIPPED;
+    }
+
+    trace_begin("stage", stage_name(STAGE_READ));
+    uint64_t stage_start = monotonic_ns();
+    size_t size = (size_t)st.st_size;
+    char *data = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    if (data == MAP_FAILED || !is_passthrough(data, size))
+    {
+        if (data != MAP_FAILED)
+            munmap(data, size);
+        close(in_fd);
+        trace_end();
+        return FAST_PATH_SKIPPED;
+    }
+
+    compiler->stats.input_size = (int)size;
+    compiler->stats.input_lines = count_lines(data, size);
+    size_t error_offset;
+    if (!utf8_validate(data, size, &error_offset))
+    {
+        fprintf(stderr, "Avviso: sequenza UTF-8 non valida in %s all'offset %zu (riga %d)\n",
+                compiler->input_filename, error_offset, count_lines(data, error_offset) + 1);
+    }
+    compiler->stage_ns[STAGE_READ] = monotonic_ns() - stage_start;
+    compiler->stage_ran[STAGE_READ] = true;
+    trace_end();
+
+    // Il controllo dei nomi legge direttamente le pagine mappate
+    if (compiler->passes & PASS_CHECK && !compiler->diagnostics.limit_reached)
+    {
+        trace_begin("stage", stage_name(STAGE_CHECK));
+        stage_start = monotonic_ns();
+        DeclScanner scanner;
+        decl_scanner_init(&scanner, report_declared_name, compiler);
+        if (decl_scanner_feed(&scanner, data, size))
+            decl_scanner_finish(&scanner);
+        decl_scanner_free(&scanner);
+        compiler->stage_ns[STAGE_CHECK] = monotonic_ns() - stage_start;
+        compiler->stage_ran[STAGE_CHECK] = true;
+        trace_end();
+    }
+
+    FastPathResult result = FAST_PATH_DONE;
+    if (compiler->passes & PASS_OUTPUT)
+    {
+        trace_begin("stage", stage_name(STAGE_WRITE));
+        stage_start = monotonic_ns();
+        int out_fd = STDOUT_FILENO;
+        if (compiler->output_filename)
+            out_fd = open(compiler->output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        else
+            fflush(stdout);
+
+        if (myprecompiler_output__write_ENABLED())
+            PROBE2(output__write, compiler->output_filename ? compiler->output_filename : "-", size);
+        if (out_fd < 0)
+        {
+            fprintf(stderr, "Errore: impossibile aprire il file di output %s\n", compiler->output_filename);
+            result = FAST_PATH_FAILED;
+        }
+        else
+        {
+            int status = copy_to_output(in_fd, out_fd, data, size);
+            if (out_fd != STDOUT_FILENO && close(out_fd) != 0)
+                status = 1;
+            if (status != 0)
+            {
+                fprintf(stderr, "Errore: impossibile scrivere nel file di output %s\n",
+                        compiler->output_filename ? compiler->output_filename : "stdout");
+                result = FAST_PATH_FAILED;
+            }
+        }
+        compiler->stats.output_size = compiler->stats.input_size;
+        compiler->stats.output_lines = compiler->stats.input_lines;
+        compiler->stage_ns[STAGE_WRITE] = monotonic_ns() - stage_start;
+        compiler->stage_ran[STAGE_WRITE] = true;
+        trace_end();
+    }
+
+    munmap(data, size);
+    close(in_fd);
+    return result;
+}
@@ -0,0 +1,677 @@
+#include "../include/precompiler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Identifica il formato del file dei checkpoint (in coda al file)
+#define CHECKPOINT_MAGIC "MYPCINC2"
+
+// Le regioni terminano a fine riga, in punti scelti dal contenuto: dopo
+// una modifica i confini successivi tornano a coincidere con i precedenti
+#define REGION_MIN_SIZE (64 * 1024)
+#define REGION_MAX_SIZE (1024 * 1024)
+#define REGION_CUT_MASK 0x3f
+
+// Valori cumulativi all'inizio di una regione
+typedef struct
+{
+    long long checked_vars;
+    long long errors_detected;
+    long long comment_lines;
+    long long output_size;
+    long long output_newlines;
+    long long errors;          // Errori registrati (indice nella lista degli errori)
+} Progress;
+
+// Stato dell'elaborazione all'inizio di una regione del testo espanso
+typedef struct
+{
+    size_t offset;             // Inizio della regione nel testo espanso
+    size_t length;             // Lunghezza della regione
+    uint64_t hash;             // Hash del contenuto della regione
+    CommentState comments;     // Stato dell'automa dei commenti
+    DeclScanner scanner;       // Stato del parser delle dichiarazioni
+    Progress progress;         // Statistiche e posizione nell'output
+} Checkpoint;
+
+typedef struct
+{
+    int line_number;
+    char *var_name;
+} RecordedError;
+
+// Checkpoint di un'elaborazione completa, con l'output che ha prodotto
+typedef struct
+{
+    Checkpoint *regions;
+    int count;
+    int capacity;
+    Progress final;            // Valori alla fine dell'elaborazione
+    RecordedError *errors;     // Errori nell'ordine di rilevamento
+    int error_count;
+    int error_capacity;
+    const char *output;        // Output dell'elaborazione (nel file mappato)
+    size_t output_len;
+    void *mapping;             // File dei checkpoint mappato in memoria
+    size_t mapping_len;
+} CheckpointSet;
+
+// Elaborazione in corso
+typedef struct
+{
+    PreCompiler *compiler;
+    OutputWriter *writer;
+    FILE *saved;               // Nuovo file dei checkpoint: riceve l'output man mano
+    CheckpointSet *next;       // Checkpoint dell'elaborazione in corso
+    long long output_size;
+    long long output_newlines;
+    char last;                 // Ultimo byte scritto
+    bool failed;               // Scrittura dell'output fallita
+} IncrementalRun;
+
+// Rimescola i bit di un valore a 64 bit (finalizzatore di splitmix64)
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Hash del contenuto di una regione, 8 byte alla volta
+static uint64_t region_hash(const char *data, size_t len)
+{
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    uint64_t word = 0;
+    memcpy(&word, data + i, len - i);
+    return mix64(hash ^ word);
+}
+
+// Fine della regione che inizia in start: dopo la dimensione minima, alla
+// prima riga i cui ultimi byte soddisfano la maschera
+static size_t region_end(const char *content, size_t start, size_t len)
+{
+    size_t limit = len - start > REGION_MAX_SIZE ? start + REGION_MAX_SIZE : len;
+    if (limit - start <= REGION_MIN_SIZE)
+        return limit;
+
+    const char *p = content + start + REGION_MIN_SIZE;
+    const char *end = content + limit;
+    const char *newline;
+    while (p < end && (newline = (const char *)memchr(p, '\n', end - p)) != NULL)
+    {
+        uint64_t tail = 0;
+        for (const char *q = newline - 8; q < newline; q++)
+            tail = tail << 8 | (unsigned char)*q;
+        if ((mix64(tail) & REGION_CUT_MASK) == 0)
+            return newline + 1 - content;
+        p = newline + 1;
+    }
+    return limit;
+}
+
+static Checkpoint *add_checkpoint(CheckpointSet *set)
+{
+    if (set->count == set->capacity)
+    {
+        int new_capacity = set->capacity ? set->capacity * 2 : 64;
+        Checkpoint *regions = (Checkpoint *)realloc(set->regions, new_capacity * sizeof(Checkpoint));
+        if (!regions)
+            return NULL;
+        set->regions = regions;
+        set->capacity = new_capacity;
+    }
+    Checkpoint *checkpoint = &set->regions[set->count++];
+    memset(checkpoint, 0, sizeof(Checkpoint));
+    return checkpoint;
+}
+
+static int add_error(CheckpointSet *set, int line_number, const char *var_name)
+{
+    if (set->error_count == set->error_capacity)
+    {
+        int new_capacity = set->error_capacity ? set->error_capacity * 2 : 64;
+        RecordedError *errors = (RecordedError *)realloc(set->errors, new_capacity * sizeof(RecordedError));
+        if (!errors)
+            return 1;
+        set->errors = errors;
+        set->error_capacity = new_capacity;
+    }
+    char *copy = strdup(var_name);
+    if (!copy)
+        return 1;
+    set->errors[set->error_count].line_number = line_number;
+    set->errors[set->error_count].var_name = copy;
+    set->error_count++;
+    return 0;
+}
+
+static void free_checkpoints(CheckpointSet *set)
+{
+    for (int i = 0; i < set->count; i++)
+        decl_scanner_free(&set->regions[i].scanner);
+    free(set->regions);
+    for (int i = 0; i < set->error_count; i++)
+        free(set->errors[i].var_name);
+    free(set->errors);
+    if (set->mapping)
+        munmap(set->mapping, set->mapping_len);
+    memset(set, 0, sizeof(CheckpointSet));
+}
+
+// Divide il testo espanso in regioni
+static int split_regions(const char *content, size_t len, CheckpointSet *set)
+{
+    for (size_t start = 0; start < len;)
+    {
+        size_t end = region_end(content, start, len);
+        Checkpoint *checkpoint = add_checkpoint(set);
+        if (!checkpoint)
+            return 1;
+        checkpoint->offset = start;
+        checkpoint->length = end - start;
+        checkpoint->hash = region_hash(content + start, end - start);
+        start = end;
+    }
+    return 0;
+}
+
+// Lettura con controllo dei limiti dal file mappato
+typedef struct
+{
+    const char *data;
+    size_t len;
+    size_t pos;
+} Reader;
+
+static bool read_bytes(Reader *reader, void *value, size_t size)
+{
+    if (reader->len - reader->pos < size)
+        return false;
+    memcpy(value, reader->data + reader->pos, size);
+    reader->pos += size;
+    return true;
+}
+
+// Carica i checkpoint salvati dall'elaborazione precedente
+static bool load_checkpoints(const char *filename, CheckpointSet *set)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= 16)
+        mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    set->mapping = mapping;
+    set->mapping_len = st.st_size;
+
+    // In coda: posizione dei metadati e formato. L'output occupa l'inizio del file.
+    const char *data = (const char *)mapping;
+    uint64_t metadata;
+    memcpy(&metadata, data + st.st_size - 16, 8);
+    if (memcmp(data + st.st_size - 8, CHECKPOINT_MAGIC, 8) != 0 || metadata > (uint64_t)st.st_size - 16)
+        return false;
+    set->output = data;
+    set->output_len = metadata;
+
+    Reader reader = {data, st.st_size - 16, metadata};
+    uint32_t scanner_size, frame_size;
+    int32_t count, error_count;
+    if (!read_bytes(&reader, &scanner_size, 4) || !read_bytes(&reader, &frame_size, 4) ||
+        scanner_size != sizeof(DeclScanner) || frame_size != sizeof(DeclFrame) ||
+        !read_bytes(&reader, &count, 4) || !read_bytes(&reader, &error_count, 4) || count < 0 || error_count < 0 ||
+        !read_bytes(&reader, &set->final, sizeof(Progress)) || (uint64_t)set->final.output_size != metadata)
+        return false;
+
+    for (int i = 0; i < count; i++)
+    {
+        Checkpoint *checkpoint = add_checkpoint(set);
+        int32_t comments;
+        if (!checkpoint || !read_bytes(&reader, &checkpoint->offset, sizeof(size_t)) ||
+            !read_bytes(&reader, &checkpoint->length, sizeof(size_t)) || !read_bytes(&reader, &checkpoint->hash, 8) ||
+            !read_bytes(&reader, &comments, 4) || comments < 0 || comments >= COMMENT_STATE_COUNT ||
+            !read_bytes(&reader, &checkpoint->progress, sizeof(Progress)) ||
+            !read_bytes(&reader, &checkpoint->scanner, sizeof(DeclScanner)))
+            return false;
+        checkpoint->comments = (CommentState)comments;
+
+        // La pila dei contesti segue il parser; i puntatori salvati non sono validi
+        DeclScanner *scanner = &checkpoint->scanner;
+        scanner->frames = NULL;
+        scanner->capacity = 0;
+        if (scanner->depth < 0 || (size_t)scanner->depth > (reader.len - reader.pos) / sizeof(DeclFrame) ||
+            checkpoint->progress.output_size > set->final.output_size ||
+            checkpoint->progress.errors > error_count)
+        {
+            scanner->depth = 0;
+            return false;
+        }
+        if (scanner->depth > 0)
+        {
+            scanner->frames = (DeclFrame *)malloc(scanner->depth * sizeof(DeclFrame));
+            if (!scanner->frames)
+            {
+                scanner->depth = 0;
+                return false;
+            }
+            read_bytes(&reader, scanner->frames, scanner->depth * sizeof(DeclFrame));
+            scanner->capacity = scanner->depth;
+        }
+    }
+
+    for (int i = 0; i < error_count; i++)
+    {
+        int32_t line_number;
+        uint32_t name_len;
+        char name[DECL_NAME_MAX];
+        if (!read_bytes(&reader, &line_number, 4) || !read_bytes(&reader, &name_len, 4) ||
+            name_len >= DECL_NAME_MAX || !read_bytes(&reader, name, name_len))
+            return false;
+        name[name_len] = '\0';
+        if (add_error(set, line_number, name) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Scrive i metadati in coda all'output già salvato nel nuovo file dei checkpoint
+static int write_metadata(FILE *file, const CheckpointSet *set)
+{
+    uint64_t metadata = (uint64_t)set->final.output_size;
+    uint32_t scanner_size = sizeof(DeclScanner), frame_size = sizeof(DeclFrame);
+    int32_t count = set->count, error_count = set->error_count;
+    fwrite(&scanner_size, 4, 1, file);
+    fwrite(&frame_size, 4, 1, file);
+    fwrite(&count, 4, 1, file);
+    fwrite(&error_count, 4, 1, file);
+    fwrite(&set->final, sizeof(Progress), 1, file);
+
+    for (int i = 0; i < set->count; i++)
+    {
+        const Checkpoint *checkpoint = &set->regions[i];
+        int32_t comments = checkpoint->comments;
+        DeclScanner scanner = checkpoint->scanner;
+        scanner.report = NULL;
+        scanner.context = NULL;
+        scanner.frames = NULL;
+        fwrite(&checkpoint->offset, sizeof(size_t), 1, file);
+        fwrite(&checkpoint->length, sizeof(size_t), 1, file);
+        fwrite(&checkpoint->hash, 8, 1, file);
+        fwrite(&comments, 4, 1, file);
+        fwrite(&checkpoint->progress, sizeof(Progress), 1, file);
+        fwrite(&scanner, sizeof(DeclScanner), 1, file);
+        if (scanner.depth > 0)
+            fwrite(checkpoint->scanner.frames, sizeof(DeclFrame), scanner.depth, file);
+    }
+
+    for (int i = 0; i < set->error_count; i++)
+    {
+        int32_t line_number = set->errors[i].line_number;
+        uint32_t name_len = strlen(set->errors[i].var_name);
+        fwrite(&line_number, 4, 1, file);
+        fwrite(&name_len, 4, 1, file);
+        fwrite(set->errors[i].var_name, 1, name_len, file);
+    }
+
+    fwrite(&metadata, 8, 1, file);
+    fwrite(CHECKPOINT_MAGIC, 1, 8, file);
+    return ferror(file) ? 1 : 0;
+}
+
+// Scrive un blocco in output e nel nuovo file dei checkpoint
+static void emit(IncrementalRun *run, const char *data, size_t len, bool count_lines)
+{
+    if (len == 0 || run->failed)
+        return;
+    if (count_lines)
+    {
+        for (const char *p = data, *end = data + len; (p = memchr(p, '\n', end - p)) != NULL; p++)
+            run->output_newlines++;
+        run->output_size += len;
+    }
+    run->last = data[len - 1];
+
+    if (myprecompiler_output__write_ENABLED())
+        PROBE2(output__write, run->compiler->output_filename ? run->compiler->output_filename : "-", len);
+    if (output_write(run->writer, data, len) != 0)
+        run->failed = true;
+    if (run->saved && fwrite(data, 1, len, run->saved) != len)
+    {
+        fclose(run->saved);
+        run->saved = NULL;
+    }
+}
+
+// Callback del parser: registra gli errori per le elaborazioni successive
+static bool report_region_name(void *context, const char *name, int line_number)
+{
+    IncrementalRun *run = (IncrementalRun *)context;
+    int errors = run->compiler->stats.errors_detected;
+    bool proceed = report_declared_name(run->compiler, name, line_number);
+    if (run->compiler->stats.errors_detected != errors && add_error(run->next, line_number, name) != 0)
+        run->failed = true;
+    return proceed;
+}
+
+// Ripete gli errori di un intervallo salvato, spostandone le righe di delta
+static void replay_errors(IncrementalRun *run, const CheckpointSet *old, long long from, long long to, int delta)
+{
+    PreCompiler *compiler = run->compiler;
+    for (long long i = from; i < to; i++)
+    {
+        InvalidVariable error = {compiler->input_filename, old->errors[i].line_number + delta, old->errors[i].var_name};
+        if (compiler->cache)
+            cache_record_error(compiler->cache, error.line_number, error.var_name);
+        if (add_error(run->next, error.line_number, error.var_name) != 0)
+            run->failed = true;
+        diag_report(&compiler->diagnostics, &error);
+    }
+}
+
+// Valori cumulativi correnti
+static Progress current_progress(const IncrementalRun *run)
+{
+    Progress progress;
+    progress.checked_vars = run->compiler->stats.checked_vars;
+    progress.errors_detected = run->compiler->stats.errors_detected;
+    progress.comment_lines = run->compiler->stats.comment_lines_deleted;
+    progress.output_size = run->output_size;
+    progress.output_newlines = run->output_newlines;
+    progress.errors = run->next->error_count;
+    return progress;
+}
+
+static void set_progress(IncrementalRun *run, const Progress *progress)
+{
+    run->compiler->stats.checked_vars = (int)progress->checked_vars;
+    run->compiler->stats.errors_detected = (int)progress->errors_detected;
+    run->compiler->stats.comment_lines_deleted = (int)progress->comment_lines;
+    run->output_size = progress->output_size;
+    run->output_newlines = progress->output_newlines;
+}
+
+// Somma a un checkpoint salvato lo spostamento tra la vecchia e la nuova elaborazione
+static Progress shift_progress(const Progress *value, const Progress *old_base, const Progress *new_base)
+{
+    Progress shifted;
+    shifted.checked_vars = value->checked_vars - old_base->checked_vars + new_base->checked_vars;
+    shifted.errors_detected = value->errors_detected - old_base->errors_detected + new_base->errors_detected;
+    shifted.comment_lines = value->comment_lines - old_base->comment_lines + new_base->comment_lines;
+    shifted.output_size = value->output_size - old_base->output_size + new_base->output_size;
+    shifted.output_newlines = value->output_newlines - old_base->output_newlines + new_base->output_newlines;
+    shifted.errors = value->errors - old_base->errors + new_base->errors;
+    return shifted;
+}
+
+// Copia nel nuovo insieme il checkpoint old_index dell'elaborazione precedente,
+// spostato dei valori accumulati fino al punto di riallineamento
+static int copy_checkpoint(IncrementalRun *run, const Checkpoint *old, const Checkpoint *old_base,
+                           const Progress *new_base, int line_delta, size_t offset)
+{
+    Checkpoint *checkpoint = add_checkpoint(run->next);
+    if (!checkpoint || decl_scanner_copy(&checkpoint->scanner, &old->scanner) != 0)
+    {
+        if (checkpoint)
+            run->next->count--;
+        return 1;
+    }
+    checkpoint->offset = offset;
+    checkpoint->length = old->length;
+    checkpoint->hash = old->hash;
+    checkpoint->comments = old->comments;
+    checkpoint->progress = shift_progress(&old->progress, &old_base->progress, new_base);
+    checkpoint->scanner.line_number += line_delta;
+    checkpoint->scanner.name_line += line_delta;
+    return 0;
+}
+
+// Elabora il testo espanso partendo dal primo checkpoint cambiato e
+// riprendendo l'output precedente appena lo stato torna a coincidere
+static int process_regions(IncrementalRun *run, const char *content, size_t content_len, CheckpointSet *old, bool have_old)
+{
+    PreCompiler *compiler = run->compiler;
+    CheckpointSet *next = run->next;
+    if (split_regions(content, content_len, next) != 0)
+        return 1;
+    int count = next->count;
+
+    // Le regioni iniziali e finali identiche a quelle precedenti
+    int first = 0, common_tail = 0;
+    if (have_old)
+    {
+        while (first < count && first < old->count && next->regions[first].hash == old->regions[first].hash &&
+               next->regions[first].length == old->regions[first].length)
+            first++;
+        while (common_tail < count - first && common_tail < old->count - first &&
+               next->regions[count - 1 - common_tail].hash == old->regions[old->count - 1 - common_tail].hash &&
+               next->regions[count - 1 - common_tail].length == old->regions[old->count - 1 - common_tail].length)
+            common_tail++;
+    }
+
+    // Input invariato: tutto l'output e gli errori vengono ripresi
+    if (have_old && first == count && count == old->count)
+    {
+        next->count = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (copy_checkpoint(run, &old->regions[i], &old->regions[0], &old->regions[0].progress, 0,
+                                old->regions[i].offset) != 0)
+                return 1;
+        }
+        emit(run, old->output, old->output_len, false);
+        replay_errors(run, old, 0, old->error_count, 0);
+        next->final = old->final;
+        set_progress(run, &old->final);
+        return run->failed ? 1 : 0;
+    }
+
+    // Con regioni aggiunte in coda lo stato alla fine dell'input precedente non
+    // è salvato: si riparte dall'inizio della sua ultima regione
+    if (first > 0 && first == old->count)
+        first--;
+
+    // Stato all'inizio della prima regione cambiata
+    CommentState comments = COMMENT_STATE_CODE;
+    DeclScanner scanner;
+    if (first > 0)
+    {
+        const Checkpoint *resume = &old->regions[first];
+        if (decl_scanner_copy(&scanner, &resume->scanner) != 0)
+            return 1;
+        comments = resume->comments;
+        emit(run, old->output, resume->progress.output_size, false);
+        set_progress(run, &resume->progress);
+        replay_errors(run, old, 0, resume->progress.errors, 0);
+        for (int i = 0; i < first; i++)
+        {
+            next->regions[i].comments = old->regions[i].comments;
+            next->regions[i].progress = old->regions[i].progress;
+            if (decl_scanner_copy(&next->regions[i].scanner, &old->regions[i].scanner) != 0)
+            {
+                decl_scanner_free(&scanner);
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        decl_scanner_init(&scanner, report_region_name, run);
+    }
+    scanner.report = report_region_name;
+    scanner.context = run;
+
+    char *buffer = (char *)malloc(REGION_MAX_SIZE + 1);
+    if (!buffer)
+    {
+        decl_scanner_free(&scanner);
+        return 1;
+    }
+
+    int converged = -1;
+    int status = 0;
+    for (int r = first; r < count && status == 0; r++)
+    {
+        Checkpoint *checkpoint = &next->regions[r];
+        checkpoint->comments = comments;
+        checkpoint->progress = current_progress(run);
+        if (decl_scanner_copy(&checkpoint->scanner, &scanner) != 0)
+        {
+            status = 1;
+            break;
+        }
+
+        // Nella parte finale invariata basta ritrovare lo stato salvato
+        int j = r - count + old->count;
+        if (r > first && r >= count - common_tail && comments == old->regions[j].comments &&
+            decl_scanner_same_state(&scanner, &old->regions[j].scanner))
+        {
+            converged = j;
+            break;
+        }
+
+        uint64_t start = monotonic_ns();
+        comment_probes(comments, content + checkpoint->offset, checkpoint->length, checkpoint->offset);
+        size_t stripped = strip_comments(&comments, content + checkpoint->offset, checkpoint->length, buffer,
+                                         &compiler->stats.comment_lines_deleted);
+        compiler->stage_ns[STAGE_COMMENTS] += monotonic_ns() - start;
+        compiler->stage_ran[STAGE_COMMENTS] = true;
+        start = monotonic_ns();
+        decl_scanner_feed(&scanner, buffer, stripped);
+        compiler->stage_ns[STAGE_CHECK] += monotonic_ns() - start;
+        compiler->stage_ran[STAGE_CHECK] = true;
+        start = monotonic_ns();
+        emit(run, buffer, stripped, true);
+        compiler->stage_ns[STAGE_WRITE] += monotonic_ns() - start;
+        compiler->stage_ran[STAGE_WRITE] = true;
+        if (run->failed || time_budget_exceeded(compiler, "l'elaborazione incrementale"))
+            status = 1;
+    }
+
+    if (status == 0 && converged >= 0)
+    {
+        // Riprende output, errori e checkpoint successivi dall'elaborazione precedente
+        int r = count - old->count + converged;
+        const Checkpoint *base = &old->regions[converged];
+        Progress new_base = next->regions[r].progress;
+        int line_delta = scanner.line_number - base->scanner.line_number;
+        emit(run, old->output + base->progress.output_size, old->output_len - base->progress.output_size, false);
+        replay_errors(run, old, base->progress.errors, old->error_count, line_delta);
+
+        size_t offset = next->regions[r].offset;
+        for (int i = r; i < count; i++)
+            decl_scanner_free(&next->regions[i].scanner);
+        next->count = r;
+        for (int i = converged; i < old->count && status == 0; i++)
+        {
+            status = copy_checkpoint(run, &old->regions[i], base, &new_base, line_delta, offset);
+            offset += old->regions[i].length;
+        }
+        next->final = shift_progress(&old->final, &base->progress, &new_base);
+        next->final.errors = next->error_count;
+        set_progress(run, &next->final);
+    }
+    else if (status == 0)
+    {
+        // Fine dell'input: '/' in sospeso e ultimo nome
+        size_t tail = strip_comments_finish(&comments, buffer);
+        decl_scanner_feed(&scanner, buffer, tail);
+        decl_scanner_finish(&scanner);
+        emit(run, buffer, tail, true);
+        next->final = current_progress(run);
+    }
+
+    free(buffer);
+    decl_scanner_free(&scanner);
+    return status != 0 || run->failed ? 1 : 0;
+}
+
+// Rimuove i commenti e controlla i nomi rielaborando solo le regioni cambiate
+// rispetto all'esecuzione precedente, poi scrive l'output e i nuovi checkpoint
+int run_incremental(PreCompiler *compiler, const char *content)
+{
+    const char *filename = compiler->incremental_filename;
+    CheckpointSet old, next;
+    memset(&old, 0, sizeof(CheckpointSet));
+    memset(&next, 0, sizeof(CheckpointSet));
+    bool have_old = load_checkpoints(filename, &old);
+    if (!have_old)
+    {
+        free_checkpoints(&old);
+        memset(&old, 0, sizeof(CheckpointSet));
+    }
+
+    OutputWriter writer;
+    if (output_open(&writer, compiler->output_filename, compiler->only_if_changed) != 0)
+    {
+        free_checkpoints(&old);
+        return 1;
+    }
+    writer.capture = compiler->output_capture;
+
+    // Il nuovo file dei checkpoint sostituisce il precedente solo se completo
+    size_t name_len = strlen(filename);
+    char *temp_path = (char *)malloc(name_len + 8);
+    int temp_fd = -1;
+    if (temp_path)
+    {
+        snprintf(temp_path, name_len + 8, "%s.XXXXXX", filename);
+        temp_fd = mkstemp(temp_path);
+    }
+    IncrementalRun run = {compiler, &writer, temp_fd >= 0 ? fdopen(temp_fd, "wb") : NULL, &next, 0, 0, '\n', false};
+    if (temp_fd >= 0 && !run.saved)
+        close(temp_fd);
+
+    trace_begin("stage", "incremental");
+    int status = process_regions(&run, content, strlen(content), &old, have_old);
+    trace_end();
+
+    if (status != 0)
+    {
+        output_abort(&writer);
+    }
+    else if (output_commit(&writer) != 0)
+    {
+        status = 1;
+    }
+    else
+    {
+        compiler->output_unchanged = !writer.changed;
+        compiler->stats.output_size = (int)run.output_size;
+        compiler->stats.output_lines = (int)run.output_newlines + (run.output_size > 0 && run.last != '\n');
+    }
+
+    // L'output precedente resta mappato fino a qui: il rename non lo invalida
+    bool saved = false;
+    if (run.saved)
+    {
+        saved = status == 0 && write_metadata(run.saved, &next) == 0;
+        if (fclose(run.saved) != 0)
+            saved = false;
+        if (saved && rename(temp_path, filename) != 0)
+            saved = false;
+    }
+    if (!saved && temp_fd >= 0)
+        unlink(temp_path);
+    if (status == 0 && !saved)
+        fprintf(stderr, "Avviso: impossibile salvare i checkpoint in %s\n", filename);
+
+    free(temp_path);
+    free_checkpoints(&old);
+    free_checkpoints(&next);
+    return status;
+}
@@ -1,5 +1,161 @@
 #include "../include/precompiler.h"
 
+// Esegue in sequenza i passi richiesti dopo la lettura e scrive l'output.
+// Libera content in ogni caso.
+static int run_sequential(PreCompiler* compiler, char* content) {
+    uint64_t stage_start;
+    
+    // Solo controllo: nessun buffer di output, solo la diagnostica
+    if (!(compiler->passes & PASS_OUTPUT)) {
+        trace_begin("stage", stage_name(STAGE_CHECK));
+        stage_start = monotonic_ns();
+        int status = check_variables_only(content, compiler);
+        compiler->stage_ns[STAGE_CHECK] = monotonic_ns() - stage_start;
+        compiler->stage_ran[STAGE_CHECK] = true;
+        trace_end();
+        free(content);
+        return status;
+    }
+    
+    // 1. Risolve le direttive #include
+    if (compiler->passes & PASS_INCLUDES) {
+        trace_begin("stage", stage_name(STAGE_INCLUDES));
+        stage_start = monotonic_ns();
+        char* content_with_includes = resolve_includes(content, compiler);
+        compiler->stage_ns[STAGE_INCLUDES] = monotonic_ns() - stage_start;
+        compiler->stage_ran[STAGE_INCLUDES] = true;
+        trace_end();
+        free(content);
+        content = content_with_includes;
+        if (!content) {
+            return 1;
+        }
+        if (time_budget_exceeded(compiler, "l'espansione degli #include")) {
+            free(content);
+            return 1;
+        }
+    }
+    
+    // 2-4. In modalità incrementale commenti e nomi vengono rielaborati solo
+    // dove il testo espanso è cambiato, e l'output viene scritto man mano
+    if (compiler->incremental_filename) {
+        int status = run_incremental(compiler, content);
+        free(content);
+        return status;
+    }
+    
+    // 2. Rimuove i commenti
+    if (compiler->passes & PASS_COMMENTS) {
+        trace_begin("stage", stage_name(STAGE_COMMENTS));
+        stage_start = monotonic_ns();
+        char* content_without_coments = remove_comments(content, compiler);
+        compiler->stage_ns[STAGE_COMMENTS] = monotonic_ns() - stage_start;
+        compiler->stage_ran[STAGE_COMMENTS] = true;
+        trace_end();
+        free(content);
+        content = content_without_coments;
+        if (!content) {
+            return 1;
+        }
+        if (time_budget_exceeded(compiler, "la rimozione dei commenti")) {
+            free(content);
+            return 1;
+        }
+    }
+
+    // 3. Controlla i nomi delle variabili
+    if (compiler->passes & PASS_CHECK) {
+        trace_begin("stage", stage_name(STAGE_CHECK));
+        stage_start = monotonic_ns();
+        char* checked_content = check_variables_name(content, compiler);
+        compiler->stage_ns[STAGE_CHECK] = monotonic_ns() - stage_start;
+        compiler->stage_ran[STAGE_CHECK] = true;
+        trace_end();
+        free(content);
+        content = checked_content;
+        if (!content) {
+            return 1;
+        }
+        if (time_budget_exceeded(compiler, "il controllo dei nomi")) {
+            free(content);
+            return 1;
+        }
+    }
+    char* final_content = content;
+    
+    // 4. Calcola le statistiche finali
+    compiler->stats.output_size = strlen(final_content);
+    for (int i = 0; i < compiler->stats.output_size; i++) {
+        if (final_content[i] == '\n') {
+            compiler->stats.output_lines++;
+        }
+    }
+    if (compiler->stats.output_size > 0 && final_content[compiler->stats.output_size - 1] != '\n') {
+        compiler->stats.output_lines++;
+    }
+    
+    // 5. Scrive l'output (su stdout se non è specificato un file di output)
+    trace_begin("stage", stage_name(STAGE_WRITE));
+    stage_start = monotonic_ns();
+    OutputWriter writer;
+    if (output_open(&writer, compiler->output_filename, compiler->only_if_changed) != 0) {
+        free(final_content);
+        return 1;
+    }
+    writer.capture = compiler->output_capture;
+    
+    if (myprecompiler_output__write_ENABLED())
+        PROBE2(output__write, compiler->output_filename ? compiler->output_filename : "-", compiler->stats.output_size);
+    if (output_write(&writer, final_content, compiler->stats.output_size) != 0) {
+        output_abort(&writer);
+        free(final_content);
+        return 1;
+    }
+    
+    if (output_commit(&writer) != 0) {
+        free(final_content);
+        return 1;
+    }
+    compiler->output_unchanged = !writer.changed;
+    compiler->stage_ns[STAGE_WRITE] = monotonic_ns() - stage_start;
+    compiler->stage_ran[STAGE_WRITE] = true;
+    trace_end();
+    
+    free(final_content);
+    return 0;
+}
+
+// Legge l'input ed esegue i passi richiesti: a flusso, in sequenza oppure
+// con le fasi in parallelo su thread separati
+static int process_input(PreCompiler* compiler) {
+    // stdin e pipe vengono elaborati a blocchi, senza attendere la fine dell'input
+    if (!compiler->pipelined && !compiler->incremental_filename && is_stream_input(compiler->input_filename)) {
+        return run_streaming(compiler);
+    }
+    
+    trace_begin("stage", stage_name(STAGE_READ));
+    uint64_t stage_start = monotonic_ns();
+    int input_size, input_lines;
+    char* content = read_file_content(compiler, compiler->input_filename, &input_size, &input_lines);
+    compiler->stage_ns[STAGE_READ] = monotonic_ns() - stage_start;
+    compiler->stage_ran[STAGE_READ] = true;
+    trace_end();
+    if (!content) {
+        return 1;
+    }
+    
+    // Imposta le statistiche del file di input
+    compiler->stats.input_size = input_size;
+    compiler->stats.input_lines = input_lines;
+    
+    if (compiler->pipelined) {
+        int status = run_pipeline(compiler, content);
+        free(content);
+        return status;
+    }
+    return run_sequential(compiler, content);
+}
+
 int main(int argc, char* argv[]) {
     // 1. Inizializza la struttura PreCompiler
     PreCompiler* compiler = init_precompiler();
@@ -20,80 +176,75 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    // 4. Legge il contenuto del file di input
-    int input_size, input_lines;
-    char* content = read_file_content(compiler->input_filename, &input_size, &input_lines);
-    if (!content) {
+    // Apre il sink della diagnostica, che riceve gli errori man mano che vengono rilevati
+    if (diag_sink_open(&compiler->diagnostics) != 0) {
+        free_precompiler(compiler);
         return 1;
     }
     
-    // 5. Imposta le statistiche del file di input
-    compiler->stats.input_size = input_size;
-    compiler->stats.input_lines = input_lines;
-    
-    // 6. Risolve le direttive #include
-    char* content_with_includes = resolve_includes(content, compiler);
-    free(content);
-    if (!content_with_includes) {
-        return 1;
+    // Il limite di tempo vale per l'intera elaborazione, dalla lettura dell'input in poi
+    if (compiler->limits.time_budget_ns > 0) {
+        compiler->deadline_ns = monotonic_ns() + compiler->limits.time_budget_ns;
     }
     
-    // 7. Rimuove i commenti
-    char* content_without_coments = remove_comments(content_with_includes, compiler);
-    free(content_with_includes);
-    if (!content_without_coments) {
-        return 1;
-    }
-
-    // 8. Controlla i nomi delle variabili
-    char* final_content = check_variables_name(content_without_coments, compiler);
-    free(content_without_coments);
-    if (!final_content) {
-        return 1;
+    if (compiler->trace_filename) {
+        trace_start();
+        trace_set_thread_name("main");
     }
+    trace_begin("file", compiler->unity ? "unity" : compiler->input_filename);
     
-    // 9. Calcola le statistiche finali
-    compiler->stats.output_size = strlen(final_content);
-    for (int i = 0; i < compiler->stats.output_size; i++) {
-        if (final_content[i] == '\n') {
-            compiler->stats.output_lines++;
+    // 4. Un risultato già presente nella cache viene riprodotto; gli input che
+    // nessun passo modificherebbe vengono copiati direttamente; in modalità
+    // unity tutte le unità confluiscono in un unico output
+    int status;
+    CacheResult cached = cache_lookup(compiler);
+    if (cached != CACHE_MISS) {
+        status = cached == CACHE_HIT ? 0 : 1;
+    } else if (compiler->unity) {
+        status = run_unity(compiler);
+    } else {
+        FastPathResult fast_path = run_fast_path(compiler);
+        status = fast_path == FAST_PATH_FAILED ? 1 : 0;
+        if (fast_path == FAST_PATH_SKIPPED) {
+            status = process_input(compiler);
+            if (status == 0) {
+                cache_store(compiler);
+            }
         }
     }
-    if (compiler->stats.output_size > 0 && final_content[compiler->stats.output_size - 1] != '\n') {
-        compiler->stats.output_lines++;
-    }
+    trace_end();
     
-    // 10. Scrive l'output
-    if (compiler->output_filename) {
-        FILE* output_file = fopen(compiler->output_filename, "w");
-        if (!output_file) {
-            fprintf(stderr, "Errore: impossibile aprire il file di output %s\n", compiler->output_filename);
-            free(final_content);
-            return 1;
+    // 5. Completa la diagnostica anche se l'elaborazione è fallita: gli errori
+    // già rilevati sono ancora nel buffer del sink
+    compiler->diagnostics.interrupted = compiler->aborted;
+    diag_sink_finish(&compiler->diagnostics, compiler->stats.checked_vars, compiler->stats.errors_detected);
+    if (status == 0 || compiler->aborted) {
+        // Stampa le statistiche se richiesto; dopo un limite superato descrivono
+        // quanto è stato elaborato prima dell'interruzione
+        if (compiler->verbose) {
+            print_stats(compiler);
         }
-        
-        if (fputs(final_content, output_file) == EOF) {
-            fprintf(stderr, "Errore: impossibile scrivere nel file di output %s\n", compiler->output_filename);
-            fclose(output_file);
-            free(final_content);
-            return 1;
+        if (compiler->include_report) {
+            print_include_report(compiler);
+        }
+        if (compiler->include_folded_filename &&
+            write_include_folded(compiler, compiler->include_folded_filename) != 0) {
+            status = 1;
         }
-        
-        fclose(output_file);
-    } else {
-        // Scrive su stdout se non è specificato un file di output
-        fputs(final_content, stdout);
     }
     
-    // 11. Stampa le statistiche se richiesto
-    if (compiler->verbose) {
-        print_stats(compiler);
+    // Metriche e trace servono anche per capire un'elaborazione fallita
+    if (compiler->metrics_filename &&
+        update_metrics_file(compiler, compiler->metrics_filename, status != 0) != 0) {
+        status = 1;
+    }
+    if (compiler->trace_filename &&
+        trace_write(compiler->trace_filename) != 0) {
+        status = 1;
     }
     
-    free(final_content);
-    
-    // 12. Libera la memoria
+    // 6. Libera la memoria
     free_precompiler(compiler);
     
-    return 0;
+    return status;
 } 
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "../include/precompiler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// Famiglie di metriche scritte da myPreCompiler
+typedef struct
+{
+    const char *name;
+    const char *type;
+    const char *help;
+} MetricFamily;
+
+static const MetricFamily metric_families[] = {
+    {"myprecompiler_runs_total", "counter", "Numero di esecuzioni completate."},
+    {"myprecompiler_runs_failed_total", "counter", "Esecuzioni terminate con un errore."},
+    {"myprecompiler_checked_vars_total", "counter", "Variabili controllate."},
+    {"myprecompiler_errors_detected_total", "counter", "Nomi di variabile non validi rilevati."},
+    {"myprecompiler_comment_lines_deleted_total", "counter", "Righe di commento eliminate."},
+    {"myprecompiler_files_included_total", "counter", "File inclusi tramite #include."},
+    {"myprecompiler_input_bytes_total", "counter", "Byte letti dai file di input."},
+    {"myprecompiler_input_lines_total", "counter", "Righe lette dai file di input."},
+    {"myprecompiler_output_bytes_total", "counter", "Byte scritti in output."},
+    {"myprecompiler_output_lines_total", "counter", "Righe scritte in output."},
+    {"myprecompiler_stage_duration_seconds", "histogram", "Durata di ogni fase dell'elaborazione."},
+};
+
+// Limiti superiori dei bucket dell'istogramma delle durate (secondi)
+static const double duration_buckets[] = {0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5};
+
+// Singolo campione: nome con etichette e valore
+typedef struct
+{
+    char *key;
+    double value;
+} MetricSample;
+
+typedef struct
+{
+    MetricSample *samples;
+    int count;
+    int capacity;
+} MetricSet;
+
+// Somma un valore al campione con la chiave indicata, creandolo se non esiste
+static int metric_add(MetricSet *set, const char *key, double value)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        if (strcmp(set->samples[i].key, key) == 0)
+        {
+            set->samples[i].value += value;
+            return 0;
+        }
+    }
+
+    if (set->count == set->capacity)
+    {
+        int new_capacity = set->capacity ? set->capacity * 2 : 64;
+        MetricSample *samples = (MetricSample *)realloc(set->samples, new_capacity * sizeof(MetricSample));
+        if (!samples)
+            return 1;
+        set->samples = samples;
+        set->capacity = new_capacity;
+    }
+
+    char *copy = strdup(key);
+    if (!copy)
+        return 1;
+    set->samples[set->count].key = copy;
+    set->samples[set->count].value = value;
+    set->count++;
+    return 0;
+}
+
+static void metric_set_free(MetricSet *set)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        free(set->samples[i].key);
+    }
+    free(set->samples);
+}
+
+// Legge i campioni già presenti nel file, se esiste
+static int load_existing_metrics(MetricSet *set, const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+        return 0;
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    int status = 0;
+    while (getline(&line, &line_capacity, file) != -1)
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\0')
+            continue;
+
+        // La chiave termina al primo spazio fuori dalle etichette
+        char *p = line;
+        bool in_labels = false, in_quotes = false;
+        for (; *p; p++)
+        {
+            if (in_quotes)
+            {
+                if (*p == '\\' && p[1])
+                    p++;
+                else if (*p == '"')
+                    in_quotes = false;
+            }
+            else if (*p == '"' && in_labels)
+                in_quotes = true;
+            else if (*p == '{')
+                in_labels = true;
+            else if (*p == '}')
+                in_labels = false;
+            else if (*p == ' ' && !in_labels)
+                break;
+        }
+        if (*p != ' ')
+            continue;
+
+        *p = '\0';
+        char *end;
+        double value = strtod(p + 1, &end);
+        if (end == p + 1)
+            continue;
+        if (metric_add(set, line, value) != 0)
+        {
+            status = 1;
+            break;
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return status;
+}
+
+// Aggiunge le metriche di questa esecuzione
+static int add_run_metrics(MetricSet *set, const PreCompiler *compiler, bool failed)
+{
+    const Stats *stats = &compiler->stats;
+    int status = 0;
+    status |= metric_add(set, failed ? "myprecompiler_runs_failed_total" : "myprecompiler_runs_total", 1);
+    status |= metric_add(set, "myprecompiler_checked_vars_total", stats->checked_vars);
+    status |= metric_add(set, "myprecompiler_errors_detected_total", stats->errors_detected);
+    status |= metric_add(set, "myprecompiler_comment_lines_deleted_total", stats->comment_lines_deleted);
+    status |= metric_add(set, "myprecompiler_files_included_total", stats->files_included);
+    status |= metric_add(set, "myprecompiler_input_bytes_total", stats->input_size);
+    status |= metric_add(set, "myprecompiler_input_lines_total", stats->input_lines);
+    status |= metric_add(set, "myprecompiler_output_bytes_total", stats->output_size);
+    status |= metric_add(set, "myprecompiler_output_lines_total", stats->output_lines);
+
+    char key[160];
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        // Le fasi saltate (cache, percorso rapido, modalità a passo singolo) non sono osservazioni
+        if (!compiler->stage_ran[stage])
+            continue;
+        const char *name = stage_name((Stage)stage);
+        double seconds = compiler->stage_ns[stage] / 1e9;
+
+        // I bucket sono cumulativi: l'osservazione conta in tutti quelli con limite >= durata
+        for (size_t b = 0; b < sizeof(duration_buckets) / sizeof(duration_buckets[0]); b++)
+        {
+            snprintf(key, sizeof(key), "myprecompiler_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"}", name, duration_buckets[b]);
+            status |= metric_add(set, key, seconds <= duration_buckets[b] ? 1 : 0);
+        }
+        snprintf(key, sizeof(key), "myprecompiler_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"}", name);
+        status |= metric_add(set, key, 1);
+        snprintf(key, sizeof(key), "myprecompiler_stage_duration_seconds_sum{stage=\"%s\"}", name);
+        status |= metric_add(set, key, seconds);
+        snprintf(key, sizeof(key), "myprecompiler_stage_duration_seconds_count{stage=\"%s\"}", name);
+        status |= metric_add(set, key, 1);
+    }
+    return status;
+}
+
+// Restituisce la famiglia nota a cui appartiene un campione, o NULL
+static const MetricFamily *family_of(const char *key)
+{
+    size_t key_len = strcspn(key, "{");
+    for (size_t i = 0; i < sizeof(metric_families) / sizeof(metric_families[0]); i++)
+    {
+        size_t name_len = strlen(metric_families[i].name);
+        if (key_len < name_len || strncmp(key, metric_families[i].name, name_len) != 0)
+            continue;
+        const char *suffix = key + name_len;
+        size_t suffix_len = key_len - name_len;
+        if (suffix_len == 0 ||
+            (strcmp(metric_families[i].type, "histogram") == 0 &&
+             ((suffix_len == 7 && strncmp(suffix, "_bucket", 7) == 0) ||
+              (suffix_len == 4 && strncmp(suffix, "_sum", 4) == 0) ||
+              (suffix_len == 6 && strncmp(suffix, "_count", 6) == 0))))
+            return &metric_families[i];
+    }
+    return NULL;
+}
+
+// Scrive tutti i campioni nel formato testuale di Prometheus
+static int write_metrics(FILE *file, const MetricSet *set)
+{
+    const MetricFamily *current = NULL;
+    for (int i = 0; i < set->count; i++)
+    {
+        const MetricFamily *family = family_of(set->samples[i].key);
+        if (family && family != current)
+        {
+            fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", family->name, family->help, family->name, family->type);
+        }
+        current = family;
+        if (fprintf(file, "%s %.17g\n", set->samples[i].key, set->samples[i].value) < 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Aggiorna il file di metriche Prometheus sommando quelle di questa esecuzione.
+// Un lock esclusivo su file.lock serializza le esecuzioni concorrenti e il
+// nuovo contenuto sostituisce il file con rename(), così il collector non
+// legge mai un file scritto a metà. Anche un'esecuzione fallita (failed)
+// contribuisce con il lavoro svolto e le durate delle fasi eseguite.
+int update_metrics_file(const PreCompiler *compiler, const char *filename, bool failed)
+{
+    size_t name_len = strlen(filename);
+    char *lock_path = (char *)malloc(name_len + 6);
+    char *temp_path = (char *)malloc(name_len + 8);
+    if (!lock_path || !temp_path)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per le metriche\n");
+        free(lock_path);
+        free(temp_path);
+        return 1;
+    }
+    snprintf(lock_path, name_len + 6, "%s.lock", filename);
+    snprintf(temp_path, name_len + 8, "%s.XXXXXX", filename);
+
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0666);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0)
+    {
+        fprintf(stderr, "Errore: impossibile bloccare il file di metriche %s\n", lock_path);
+        if (lock_fd >= 0)
+            close(lock_fd);
+        free(lock_path);
+        free(temp_path);
+        return 1;
+    }
+
+    MetricSet set = {NULL, 0, 0};
+    int status = load_existing_metrics(&set, filename);
+    if (status == 0)
+        status = add_run_metrics(&set, compiler, failed);
+
+    int temp_fd = status == 0 ? mkstemp(temp_path) : -1;
+    FILE *file = temp_fd >= 0 ? fdopen(temp_fd, "w") : NULL;
+    if (!file)
+    {
+        fprintf(stderr, "Errore: impossibile scrivere il file di metriche %s\n", filename);
+        if (temp_fd >= 0)
+        {
+            close(temp_fd);
+            unlink(temp_path);
+        }
+        status = 1;
+    }
+    else
+    {
+        fchmod(temp_fd, 0644);
+        status = write_metrics(file, &set);
+        if (fflush(file) != 0 || fsync(temp_fd) != 0)
+            status = 1;
+        if (fclose(file) != 0)
+            status = 1;
+        if (status == 0 && rename(temp_path, filename) != 0)
+            status = 1;
+        if (status != 0)
+        {
+            fprintf(stderr, "Errore: impossibile aggiornare il file di metriche %s\n", filename);
+            unlink(temp_path);
+        }
+    }
+
+    metric_set_free(&set);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+    free(lock_path);
+    free(temp_path);
+    return status;
+}
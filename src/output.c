@@ -0,0 +1,316 @@
+#include "../include/output.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Dimensione dei blocchi usati per confrontare e copiare i file
+#define OUTPUT_CHUNK_SIZE (64 * 1024)
+
+// Crea il file temporaneo nella stessa directory della destinazione,
+// così che rename() resti atomico
+static int open_temp_file(OutputWriter *writer)
+{
+    size_t path_len = strlen(writer->path);
+    writer->temp_path = (char *)malloc(path_len + 8);
+    if (!writer->temp_path)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il file temporaneo\n");
+        return 1;
+    }
+    memcpy(writer->temp_path, writer->path, path_len);
+    memcpy(writer->temp_path + path_len, ".XXXXXX", 8);
+
+    int fd = mkstemp(writer->temp_path);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Errore: impossibile creare il file temporaneo per %s\n", writer->path);
+        free(writer->temp_path);
+        writer->temp_path = NULL;
+        return 1;
+    }
+
+    // mkstemp crea il file con permessi 0600: conserva quelli della destinazione
+    // esistente, altrimenti usa quelli che avrebbe avuto con fopen
+    struct stat st;
+    if ((writer->previous && fstat(fileno(writer->previous), &st) == 0) || stat(writer->path, &st) == 0)
+    {
+        fchmod(fd, st.st_mode & 07777);
+    }
+    else
+    {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    writer->stream = fdopen(fd, "wb");
+    if (!writer->stream)
+    {
+        close(fd);
+        unlink(writer->temp_path);
+        free(writer->temp_path);
+        writer->temp_path = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+// Alla prima differenza crea il file temporaneo e vi copia il prefisso
+// già confrontato, che coincide con l'inizio del file esistente
+static int diverge(OutputWriter *writer)
+{
+    writer->identical = false;
+    if (open_temp_file(writer) != 0)
+        return 1;
+
+    if (writer->written > 0)
+    {
+        char *buffer = (char *)malloc(OUTPUT_CHUNK_SIZE);
+        if (!buffer)
+        {
+            fprintf(stderr, "Errore: impossibile allocare memoria per la copia dell'output\n");
+            return 1;
+        }
+        rewind(writer->previous);
+        size_t remaining = writer->written;
+        while (remaining > 0)
+        {
+            size_t chunk = remaining < OUTPUT_CHUNK_SIZE ? remaining : OUTPUT_CHUNK_SIZE;
+            if (fread(buffer, 1, chunk, writer->previous) != chunk ||
+                fwrite(buffer, 1, chunk, writer->stream) != chunk)
+            {
+                free(buffer);
+                fprintf(stderr, "Errore: impossibile copiare l'output precedente di %s\n", writer->path);
+                return 1;
+            }
+            remaining -= chunk;
+        }
+        free(buffer);
+    }
+
+    fclose(writer->previous);
+    writer->previous = NULL;
+    return 0;
+}
+
+// Apre l'output; path NULL indica stdout
+int output_open(OutputWriter *writer, const char *path, bool only_if_changed)
+{
+    memset(writer, 0, sizeof(OutputWriter));
+
+    if (!path)
+    {
+        writer->stream = stdout;
+        writer->changed = true;
+        return 0;
+    }
+
+    writer->path = strdup(path);
+    if (!writer->path)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il nome del file di output\n");
+        return 1;
+    }
+
+    Codec codec = codec_from_filename(path);
+    if (codec != CODEC_NONE)
+    {
+        writer->encoder = encoder_open(codec);
+        if (!writer->encoder)
+        {
+            free(writer->path);
+            writer->path = NULL;
+            return 1;
+        }
+    }
+
+    if (only_if_changed)
+    {
+        writer->only_if_changed = true;
+        writer->previous = fopen(path, "rb");
+        if (writer->previous)
+        {
+            // Il confronto parte solo se esiste già un file da confrontare
+            writer->identical = true;
+            return 0;
+        }
+        return open_temp_file(writer);
+    }
+
+    writer->stream = fopen(path, writer->encoder ? "wb" : "w");
+    if (!writer->stream)
+    {
+        fprintf(stderr, "Errore: impossibile aprire il file di output %s\n", path);
+        encoder_free(writer->encoder);
+        writer->encoder = NULL;
+        free(writer->path);
+        writer->path = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+// Scrive un blocco di dati già compresso (se necessario) sulla destinazione
+static int write_raw(OutputWriter *writer, const char *data, size_t len)
+{
+    if (writer->identical)
+    {
+        // Confronto in streaming con il file esistente
+        char buffer[4096];
+        size_t offset = 0;
+        while (offset < len)
+        {
+            size_t chunk = len - offset < sizeof(buffer) ? len - offset : sizeof(buffer);
+            size_t read_size = fread(buffer, 1, chunk, writer->previous);
+            if (read_size != chunk || memcmp(buffer, data + offset, chunk) != 0)
+            {
+                if (diverge(writer) != 0)
+                    return 1;
+                break;
+            }
+            offset += chunk;
+            writer->written += chunk;
+        }
+        if (writer->identical)
+            return 0;
+        data += offset;
+        len -= offset;
+    }
+
+    if (len > 0 && fwrite(data, 1, len, writer->stream) != len)
+    {
+        fprintf(stderr, "Errore: impossibile scrivere nel file di output %s\n", writer->path ? writer->path : "stdout");
+        return 1;
+    }
+    writer->written += len;
+    return 0;
+}
+
+// Adattatore per ricevere i blocchi prodotti dal compressore
+static int emit_raw(void *context, const char *data, size_t len)
+{
+    return write_raw((OutputWriter *)context, data, len);
+}
+
+// Accoda un blocco alla copia in memoria dell'output
+static void capture_append(OutputCapture *capture, const char *data, size_t len)
+{
+    if (capture->failed)
+        return;
+    if (capture->len + len > capture->capacity)
+    {
+        size_t new_capacity = capture->capacity ? capture->capacity : OUTPUT_CHUNK_SIZE;
+        while (new_capacity < capture->len + len)
+            new_capacity *= 2;
+        char *new_data = (char *)realloc(capture->data, new_capacity);
+        if (!new_data)
+        {
+            capture->failed = true;
+            return;
+        }
+        capture->data = new_data;
+        capture->capacity = new_capacity;
+    }
+    memcpy(capture->data + capture->len, data, len);
+    capture->len += len;
+}
+
+// Scrive un blocco di dati
+int output_write(OutputWriter *writer, const char *data, size_t len)
+{
+    if (writer->capture)
+        capture_append(writer->capture, data, len);
+    if (writer->encoder)
+    {
+        if (encoder_write(writer->encoder, data, len, emit_raw, writer) != 0)
+        {
+            fprintf(stderr, "Errore: impossibile comprimere l'output %s\n", writer->path);
+            return 1;
+        }
+        return 0;
+    }
+    return write_raw(writer, data, len);
+}
+
+// Completa la scrittura e, se necessario, sostituisce atomicamente il file
+int output_commit(OutputWriter *writer)
+{
+    int status = 0;
+
+    // Chiude lo stream compresso prima del confronto finale
+    if (writer->encoder)
+    {
+        int ret = encoder_finish(writer->encoder, emit_raw, writer);
+        encoder_free(writer->encoder);
+        writer->encoder = NULL;
+        if (ret != 0)
+        {
+            fprintf(stderr, "Errore: impossibile comprimere l'output %s\n", writer->path);
+            output_abort(writer);
+            return 1;
+        }
+    }
+
+    // Il file esistente è più lungo del nuovo output: il contenuto è cambiato
+    if (writer->identical && fgetc(writer->previous) != EOF)
+    {
+        if (diverge(writer) != 0)
+        {
+            output_abort(writer);
+            return 1;
+        }
+    }
+
+    if (writer->identical)
+    {
+        // Contenuto identico: il file esistente (e il suo mtime) resta invariato
+        fclose(writer->previous);
+        writer->previous = NULL;
+        writer->changed = false;
+    }
+    else if (writer->stream == stdout)
+    {
+        fflush(stdout);
+    }
+    else
+    {
+        if (fclose(writer->stream) != 0)
+        {
+            fprintf(stderr, "Errore: impossibile scrivere nel file di output %s\n", writer->path);
+            status = 1;
+        }
+        writer->stream = NULL;
+
+        if (status == 0 && writer->temp_path && rename(writer->temp_path, writer->path) != 0)
+        {
+            fprintf(stderr, "Errore: impossibile sostituire il file di output %s\n", writer->path);
+            status = 1;
+        }
+        if (status != 0 && writer->temp_path)
+            unlink(writer->temp_path);
+        writer->changed = status == 0;
+    }
+
+    free(writer->temp_path);
+    writer->temp_path = NULL;
+    free(writer->path);
+    writer->path = NULL;
+    return status;
+}
+
+// Interrompe la scrittura eliminando il file temporaneo
+void output_abort(OutputWriter *writer)
+{
+    if (writer->previous)
+        fclose(writer->previous);
+    if (writer->stream && writer->stream != stdout)
+        fclose(writer->stream);
+    if (writer->temp_path)
+        unlink(writer->temp_path);
+    encoder_free(writer->encoder);
+    free(writer->temp_path);
+    free(writer->path);
+    memset(writer, 0, sizeof(OutputWriter));
+}
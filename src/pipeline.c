@@ -0,0 +1,441 @@
+#include "../include/precompiler.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// Dimensione dei blocchi che passano da una fase all'altra
+#define PIPE_CHUNK_SIZE (64 * 1024)
+
+// Blocchi in transito tra due fasi (potenza di 2)
+#define PIPE_RING_SLOTS 16
+
+// Blocco di testo in transito. I byte in più accolgono il '/' in sospeso
+// dal blocco precedente; la compattazione, che riporta anche gli spazi in
+// sospeso, può richiedere un blocco più grande.
+#define PIPE_CHUNK_CAPACITY (PIPE_CHUNK_SIZE + COMPACT_SLACK)
+
+typedef struct
+{
+    size_t len;
+    size_t capacity;
+    char data[];
+} PipeChunk;
+
+// Coda circolare lock-free a singolo produttore e singolo consumatore.
+// head è scritto solo dal consumatore e tail solo dal produttore, su linee
+// di cache distinte; un puntatore NULL segnala la fine del flusso.
+typedef struct
+{
+    PipeChunk *slots[PIPE_RING_SLOTS];
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+} PipeRing;
+
+// Stato condiviso dalle fasi
+typedef struct
+{
+    PreCompiler *compiler;
+    const char *content;       // Input già letto
+    PipeRing expanded;         // #include risolti -> rimozione dei commenti
+    PipeRing stripped;         // Commenti rimossi -> controllo dei nomi
+    PipeRing checked;          // Nomi controllati -> scrittura
+    atomic_bool cancelled;     // Una fase è fallita: tutte le altre si fermano
+    PipeChunk *pending;        // Blocco in riempimento nella fase degli #include
+} Pipeline;
+
+// Attesa attiva breve, poi cede il processore
+static void pipe_backoff(unsigned *spins)
+{
+    if (++*spins > 64)
+        sched_yield();
+}
+
+// Accoda un blocco; restituisce false se l'elaborazione è stata annullata
+static bool ring_push(Pipeline *pipeline, PipeRing *ring, PipeChunk *chunk)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned spins = 0;
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == PIPE_RING_SLOTS)
+    {
+        if (atomic_load_explicit(&pipeline->cancelled, memory_order_relaxed))
+            return false;
+        pipe_backoff(&spins);
+    }
+    ring->slots[tail % PIPE_RING_SLOTS] = chunk;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Estrae un blocco (NULL alla fine del flusso); restituisce false se l'elaborazione è stata annullata
+static bool ring_pop(Pipeline *pipeline, PipeRing *ring, PipeChunk **chunk)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned spins = 0;
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+    {
+        if (atomic_load_explicit(&pipeline->cancelled, memory_order_relaxed))
+            return false;
+        pipe_backoff(&spins);
+    }
+    *chunk = ring->slots[head % PIPE_RING_SLOTS];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+// Libera i blocchi rimasti in una coda dopo un annullamento
+static void ring_drain(PipeRing *ring)
+{
+    size_t tail = atomic_load(&ring->tail);
+    for (size_t i = atomic_load(&ring->head); i != tail; i++)
+        free(ring->slots[i % PIPE_RING_SLOTS]);
+}
+
+// Annulla l'elaborazione in tutte le fasi
+static void pipeline_cancel(Pipeline *pipeline)
+{
+    atomic_store(&pipeline->cancelled, true);
+}
+
+static PipeChunk *chunk_alloc(size_t capacity)
+{
+    PipeChunk *chunk = (PipeChunk *)malloc(sizeof(PipeChunk) + capacity);
+    if (!chunk)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per la pipeline\n");
+        return NULL;
+    }
+    chunk->len = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+// Sostituisce il blocco di riserva con uno più grande se non ha la capacità richiesta
+static bool chunk_reserve(PipeChunk **chunk, size_t capacity)
+{
+    if ((*chunk)->capacity >= capacity)
+        return true;
+    PipeChunk *larger = chunk_alloc(capacity);
+    if (!larger)
+        return false;
+    free(*chunk);
+    *chunk = larger;
+    return true;
+}
+
+// Riceve l'output di resolve_includes e lo spezza in blocchi
+static int include_sink(void *context, const char *data, size_t len)
+{
+    Pipeline *pipeline = (Pipeline *)context;
+    while (len > 0)
+    {
+        if (!pipeline->pending && !(pipeline->pending = chunk_alloc(PIPE_CHUNK_CAPACITY)))
+            return 1;
+
+        PipeChunk *chunk = pipeline->pending;
+        size_t n = PIPE_CHUNK_SIZE - chunk->len < len ? PIPE_CHUNK_SIZE - chunk->len : len;
+        memcpy(chunk->data + chunk->len, data, n);
+        chunk->len += n;
+        data += n;
+        len -= n;
+
+        if (chunk->len == PIPE_CHUNK_SIZE)
+        {
+            pipeline->pending = NULL;
+            if (!ring_push(pipeline, &pipeline->expanded, chunk))
+            {
+                free(chunk);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Fase 1: risoluzione degli #include
+static void *include_stage(void *arg)
+{
+    Pipeline *pipeline = (Pipeline *)arg;
+    PreCompiler *compiler = pipeline->compiler;
+    trace_set_thread_name("includes");
+    trace_begin("stage", stage_name(STAGE_INCLUDES));
+    uint64_t start = monotonic_ns();
+
+    compiler->include_sink = include_sink;
+    compiler->include_sink_context = pipeline;
+    char *rest = resolve_includes(pipeline->content, compiler);
+    compiler->include_sink = NULL;
+    compiler->include_sink_context = NULL;
+
+    bool ok = rest != NULL && !compiler->aborted;
+    free(rest);
+
+    // Invia l'ultimo blocco parziale e la fine del flusso
+    PipeChunk *chunk = pipeline->pending;
+    pipeline->pending = NULL;
+    if (ok && chunk && chunk->len > 0)
+    {
+        ok = ring_push(pipeline, &pipeline->expanded, chunk);
+        if (ok)
+            chunk = NULL;
+    }
+    free(chunk);
+    if (ok)
+        ok = ring_push(pipeline, &pipeline->expanded, NULL);
+    if (!ok)
+        pipeline_cancel(pipeline);
+
+    compiler->stage_ns[STAGE_INCLUDES] = monotonic_ns() - start;
+    compiler->stage_ran[STAGE_INCLUDES] = true;
+    trace_end();
+    return NULL;
+}
+
+// Fase 2: rimozione dei commenti, sul posto all'interno di ogni blocco
+static void *comment_stage(void *arg)
+{
+    Pipeline *pipeline = (Pipeline *)arg;
+    PreCompiler *compiler = pipeline->compiler;
+    trace_set_thread_name("comments");
+    trace_begin("stage", stage_name(STAGE_COMMENTS));
+    uint64_t start = monotonic_ns();
+
+    CommentState state = COMMENT_STATE_CODE;
+    size_t offset = 0;         // Posizione del blocco corrente nel testo espanso
+    Compactor compactor;
+    compactor_init(&compactor);
+
+    // Ogni passo scrive su un secondo blocco, che poi prende il posto del
+    // primo: l'automa può emettere il '/' in sospeso dal blocco precedente e
+    // la compattazione riportare byte dai blocchi precedenti
+    PipeChunk *spare = chunk_alloc(PIPE_CHUNK_CAPACITY);
+    if (!spare)
+    {
+        pipeline_cancel(pipeline);
+        compiler->stage_ns[STAGE_COMMENTS] = monotonic_ns() - start;
+        compiler->stage_ran[STAGE_COMMENTS] = true;
+        trace_end();
+        return NULL;
+    }
+
+    PipeChunk *chunk;
+    while (ring_pop(pipeline, &pipeline->expanded, &chunk))
+    {
+        if (!chunk)
+        {
+            // Fine dell'input: emette l'eventuale '/' in sospeso
+            char tail[1];
+            size_t tail_len = strip_comments_finish(&state, tail);
+            if (tail_len > 0)
+            {
+                chunk = chunk_alloc(compiler->compact ? compact_capacity(&compactor, tail_len) : tail_len);
+                if (!chunk)
+                {
+                    pipeline_cancel(pipeline);
+                    break;
+                }
+                if (compiler->compact)
+                {
+                    chunk->len = compact_lines(&compactor, tail, tail_len, chunk->data);
+                }
+                else
+                {
+                    memcpy(chunk->data, tail, tail_len);
+                    chunk->len = tail_len;
+                }
+                if (!ring_push(pipeline, &pipeline->stripped, chunk))
+                {
+                    free(chunk);
+                    break;
+                }
+            }
+            ring_push(pipeline, &pipeline->stripped, NULL);
+            break;
+        }
+
+        comment_probes(state, chunk->data, chunk->len, offset);
+        offset += chunk->len;
+        spare->len = strip_comments(&state, chunk->data, chunk->len, spare->data, &compiler->stats.comment_lines_deleted);
+        PipeChunk *stripped = spare;
+        spare = chunk;
+        chunk = stripped;
+        if (compiler->compact)
+        {
+            if (!chunk_reserve(&spare, compact_capacity(&compactor, chunk->len)))
+            {
+                free(chunk);
+                pipeline_cancel(pipeline);
+                break;
+            }
+            spare->len = compact_lines(&compactor, chunk->data, chunk->len, spare->data);
+            stripped = spare;
+            spare = chunk;
+            chunk = stripped;
+        }
+        if (chunk->len == 0)
+        {
+            free(chunk);
+            continue;
+        }
+        if (!ring_push(pipeline, &pipeline->stripped, chunk))
+        {
+            free(chunk);
+            break;
+        }
+    }
+
+    free(spare);
+    compactor_free(&compactor);
+    compiler->stage_ns[STAGE_COMMENTS] = monotonic_ns() - start;
+    compiler->stage_ran[STAGE_COMMENTS] = true;
+    trace_end();
+    return NULL;
+}
+
+// Fase 3: controllo dei nomi; i blocchi passano alla scrittura senza modifiche
+static void *check_stage(void *arg)
+{
+    Pipeline *pipeline = (Pipeline *)arg;
+    PreCompiler *compiler = pipeline->compiler;
+    trace_set_thread_name("check");
+    trace_begin("stage", stage_name(STAGE_CHECK));
+    uint64_t start = monotonic_ns();
+
+    DeclScanner scanner;
+    decl_scanner_init(&scanner, report_declared_name, compiler);
+    bool scanning = !compiler->diagnostics.limit_reached;
+
+    PipeChunk *chunk;
+    while (ring_pop(pipeline, &pipeline->stripped, &chunk))
+    {
+        if (!chunk)
+        {
+            if (scanning)
+                decl_scanner_finish(&scanner);
+            ring_push(pipeline, &pipeline->checked, NULL);
+            break;
+        }
+
+        // Raggiunto il limite di errori il parser si ferma, ma l'output prosegue
+        if (scanning)
+            scanning = decl_scanner_feed(&scanner, chunk->data, chunk->len);
+        if (!ring_push(pipeline, &pipeline->checked, chunk))
+        {
+            free(chunk);
+            break;
+        }
+    }
+    decl_scanner_free(&scanner);
+
+    compiler->stage_ns[STAGE_CHECK] = monotonic_ns() - start;
+    compiler->stage_ran[STAGE_CHECK] = true;
+    trace_end();
+    return NULL;
+}
+
+// Fase 4: scrittura dell'output, eseguita dal thread principale
+static void write_stage(Pipeline *pipeline, OutputWriter *writer)
+{
+    PreCompiler *compiler = pipeline->compiler;
+    trace_begin("stage", stage_name(STAGE_WRITE));
+    uint64_t start = monotonic_ns();
+
+    char last = '\n';
+    PipeChunk *chunk;
+    while (ring_pop(pipeline, &pipeline->checked, &chunk))
+    {
+        if (!chunk)
+        {
+            // Come nella modalità sequenziale, conta anche l'ultima riga senza newline
+            if (compiler->stats.output_size > 0 && last != '\n')
+                compiler->stats.output_lines++;
+            break;
+        }
+
+        for (size_t i = 0; i < chunk->len; i++)
+        {
+            if (chunk->data[i] == '\n')
+                compiler->stats.output_lines++;
+        }
+        compiler->stats.output_size += (int)chunk->len;
+        last = chunk->data[chunk->len - 1];
+
+        if (myprecompiler_output__write_ENABLED())
+            PROBE2(output__write, compiler->output_filename ? compiler->output_filename : "-", chunk->len);
+        int status = output_write(writer, chunk->data, chunk->len);
+        free(chunk);
+        if (status != 0)
+        {
+            pipeline_cancel(pipeline);
+            break;
+        }
+    }
+
+    compiler->stage_ns[STAGE_WRITE] = monotonic_ns() - start;
+    compiler->stage_ran[STAGE_WRITE] = true;
+    trace_end();
+}
+
+// Esegue le fasi su thread separati collegati da code a blocchi: la prima
+// parte dell'output viene scritta appena attraversa tutte le fasi, e il
+// tempo totale si avvicina a quello della fase più lenta.
+// Le durate delle fasi includono le attese sulle code.
+int run_pipeline(PreCompiler *compiler, const char *content)
+{
+    Pipeline *pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
+    if (!pipeline)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per la pipeline\n");
+        return 1;
+    }
+    pipeline->compiler = compiler;
+    pipeline->content = content;
+    atomic_init(&pipeline->cancelled, false);
+
+    OutputWriter writer;
+    if (output_open(&writer, compiler->output_filename, compiler->only_if_changed) != 0)
+    {
+        free(pipeline);
+        return 1;
+    }
+    writer.capture = compiler->output_capture;
+
+    void *(*stages[])(void *) = {include_stage, comment_stage, check_stage};
+    pthread_t threads[3];
+    int started = 0;
+    for (; started < 3; started++)
+    {
+        if (pthread_create(&threads[started], NULL, stages[started], pipeline) != 0)
+        {
+            fprintf(stderr, "Errore: impossibile avviare i thread della pipeline\n");
+            pipeline_cancel(pipeline);
+            break;
+        }
+    }
+
+    if (started == 3)
+        write_stage(pipeline, &writer);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    int status = 0;
+    if (atomic_load(&pipeline->cancelled))
+    {
+        output_abort(&writer);
+        status = 1;
+    }
+    else if (output_commit(&writer) != 0)
+    {
+        status = 1;
+    }
+    else
+    {
+        compiler->output_unchanged = !writer.changed;
+    }
+
+    ring_drain(&pipeline->expanded);
+    ring_drain(&pipeline->stripped);
+    ring_drain(&pipeline->checked);
+    free(pipeline);
+    return status;
+}
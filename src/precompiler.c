@@ -1,5 +1,11 @@
 #include "../include/precompiler.h"
 
+// Profondità massima di inclusione predefinita (come il limite di gcc)
+#define DEFAULT_MAX_INCLUDE_DEPTH 200
+
+// Dimensione massima predefinita della cache dei risultati
+#define DEFAULT_CACHE_MAX_BYTES (256LL * 1024 * 1024)
+
 // Inizializza la struttura PreCompiler
 PreCompiler *init_precompiler()
 {
@@ -12,11 +18,42 @@ PreCompiler *init_precompiler()
 
     /// Inizializza i valori
     memset(&compiler->stats, 0, sizeof(Stats));
-    compiler->errors = NULL;
+    diag_sink_init(&compiler->diagnostics);
     compiler->included_files = NULL;
+    compiler->included_files_capacity = 0;
+    compiler->current_include = -1;
     compiler->input_filename = NULL;
     compiler->output_filename = NULL;
     compiler->verbose = false;
+    compiler->only_if_changed = false;
+    compiler->output_unchanged = false;
+    compiler->include_report = false;
+    compiler->include_folded_filename = NULL;
+    compiler->metrics_filename = NULL;
+    compiler->trace_filename = NULL;
+    memset(compiler->stage_ns, 0, sizeof(compiler->stage_ns));
+    memset(compiler->stage_ran, 0, sizeof(compiler->stage_ran));
+    memset(&compiler->limits, 0, sizeof(Limits));
+    compiler->limits.max_include_depth = DEFAULT_MAX_INCLUDE_DEPTH;
+    compiler->deadline_ns = 0;
+    compiler->expanded_bytes = 0;
+    compiler->aborted = false;
+    compiler->passes = PASS_ALL;
+    compiler->system_headers = SYSTEM_HEADERS_EXPAND;
+    strset_init(&compiler->system_stubs);
+    compiler->pipelined = false;
+    compiler->unity = false;
+    compiler->units = NULL;
+    compiler->unit_count = 0;
+    compiler->include_sink = NULL;
+    compiler->include_sink_context = NULL;
+    compiler->compact = false;
+    compiler->incremental_filename = NULL;
+    compiler->missing_includes = 0;
+    compiler->cache_dir = NULL;
+    compiler->cache_max_bytes = DEFAULT_CACHE_MAX_BYTES;
+    compiler->cache = NULL;
+    compiler->output_capture = NULL;
 
     return compiler;
 }
@@ -27,20 +64,8 @@ void free_precompiler(PreCompiler *compiler)
     if (!compiler)
         return;
 
-    // Libera la memoria per gli errori
-    if (compiler->errors)
-    {
-        for (int i = 0; i < compiler->stats.errors_detected; i++)
-        {
-            if (compiler->errors[i])
-            {
-                free(compiler->errors[i]->filename);
-                free(compiler->errors[i]->var_name);
-                free(compiler->errors[i]);
-            }
-        }
-        free(compiler->errors);
-    }
+    // Chiude il sink degli errori
+    diag_sink_free(&compiler->diagnostics);
 
     // Libera la memoria per i file inclusi
     if (compiler->included_files)
@@ -61,6 +86,19 @@ void free_precompiler(PreCompiler *compiler)
         free(compiler->input_filename);
     if (compiler->output_filename)
         free(compiler->output_filename);
+    if (compiler->include_folded_filename)
+        free(compiler->include_folded_filename);
+    if (compiler->metrics_filename)
+        free(compiler->metrics_filename);
+    if (compiler->trace_filename)
+        free(compiler->trace_filename);
+    strset_free(&compiler->system_stubs);
+    for (int i = 0; i < compiler->unit_count; i++)
+        free(compiler->units[i].filename);
+    free(compiler->units);
+    free(compiler->cache_dir);
+    free(compiler->incremental_filename);
+    cache_free(compiler->cache);
 
     // Libera la struttura principale
     free(compiler);
@@ -71,34 +109,125 @@ bool is_valid_name(const char *name)
 {
     if (!name || !*name)
         return false;
-    // Il primo carattere deve essere una lettera o underscore
-    if (!isalpha((unsigned char)name[0]) && name[0] != '_')
-    {
-        return false;
-    }
 
-    // I caratteri successivi devono essere lettere, numeri o underscore
-    for (int i = 1; name[i] != '\0'; i++)
+    const unsigned char *p = (const unsigned char *)name;
+    size_t remaining = strlen(name);
+    bool first = true;
+    while (remaining > 0)
     {
-        if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+        if (*p < 0x80)
         {
-            return false;
+            // Il primo carattere deve essere una lettera o underscore,
+            // i successivi lettere, numeri o underscore
+            if (!(first ? isalpha(*p) : isalnum(*p)) && *p != '_')
+                return false;
+            p++;
+            remaining--;
+        }
+        else
+        {
+            // Caratteri Unicode ammessi negli identificatori (C11, allegato D)
+            uint32_t codepoint;
+            size_t used = utf8_decode(p, remaining, &codepoint);
+            if (used == 0)
+                return false;
+            if (!(first ? utf8_is_identifier_start(codepoint) : utf8_is_identifier_continue(codepoint)))
+                return false;
+            p += used;
+            remaining -= used;
         }
+        first = false;
     }
 
     return true;
 }
 
+// Opzioni che hanno solo la forma lunga
+enum
+{
+    OPT_DIAG_FORMAT = 256,
+    OPT_DIAG_OUT,
+    OPT_MAX_ERRORS,
+    OPT_SUMMARY_ONLY,
+    OPT_IF_CHANGED,
+    OPT_INCLUDE_REPORT,
+    OPT_INCLUDE_FOLDED,
+    OPT_METRICS_FILE,
+    OPT_MAX_INCLUDE_DEPTH,
+    OPT_MAX_INCLUDES,
+    OPT_MAX_EXPANDED_BYTES,
+    OPT_TIME_BUDGET,
+    OPT_TRACE,
+    OPT_PIPELINE,
+    OPT_CHECK_ONLY,
+    OPT_STRIP_ONLY,
+    OPT_EXPAND_ONLY,
+    OPT_SYSTEM_HEADERS,
+    OPT_SYSTEM_STUBS,
+    OPT_UNITY,
+    OPT_CACHE_DIR,
+    OPT_CACHE_MAX_BYTES,
+    OPT_COMPACT,
+    OPT_INCREMENTAL
+};
+
+// Header della libreria standard C rimossi in modalità stub se non si indica un elenco
+static const char *default_system_stubs =
+    "assert.h,complex.h,ctype.h,errno.h,fenv.h,float.h,inttypes.h,iso646.h,limits.h,locale.h,"
+    "math.h,setjmp.h,signal.h,stdalign.h,stdarg.h,stdatomic.h,stdbool.h,stddef.h,stdint.h,"
+    "stdio.h,stdlib.h,stdnoreturn.h,string.h,tgmath.h,threads.h,time.h,uchar.h,wchar.h,wctype.h";
+
+// Converte il valore numerico di un'opzione verificando che sia nell'intervallo [0, max]
+static int parse_count(const char *option_name, const char *arg, long long max, long long *value)
+{
+    char *end;
+    errno = 0;
+    long long parsed = strtoll(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || errno != 0 || parsed < 0 || parsed > max)
+    {
+        fprintf(stderr, "Errore: valore non valido per --%s: %s\n", option_name, arg);
+        return 1;
+    }
+    *value = parsed;
+    return 0;
+}
+
 // Analizza gli argomenti della riga di comando
 int parse_arguments(int argc, char *argv[], PreCompiler *compiler)
 {
     int option;
     int option_index = 0;
+    long long value;
+    bool diagnostics_requested = false;
 
     static struct option long_options[] = {
         {"in", required_argument, 0, 'i'},
         {"out", required_argument, 0, 'o'},
         {"verbose", no_argument, 0, 'v'},
+        {"diag-format", required_argument, 0, OPT_DIAG_FORMAT},
+        {"diag-out", required_argument, 0, OPT_DIAG_OUT},
+        {"max-errors", required_argument, 0, OPT_MAX_ERRORS},
+        {"summary-only", no_argument, 0, OPT_SUMMARY_ONLY},
+        {"if-changed", no_argument, 0, OPT_IF_CHANGED},
+        {"include-report", no_argument, 0, OPT_INCLUDE_REPORT},
+        {"include-folded", required_argument, 0, OPT_INCLUDE_FOLDED},
+        {"metrics-file", required_argument, 0, OPT_METRICS_FILE},
+        {"max-include-depth", required_argument, 0, OPT_MAX_INCLUDE_DEPTH},
+        {"max-includes", required_argument, 0, OPT_MAX_INCLUDES},
+        {"max-expanded-bytes", required_argument, 0, OPT_MAX_EXPANDED_BYTES},
+        {"time-budget", required_argument, 0, OPT_TIME_BUDGET},
+        {"trace", required_argument, 0, OPT_TRACE},
+        {"pipeline", no_argument, 0, OPT_PIPELINE},
+        {"check-only", no_argument, 0, OPT_CHECK_ONLY},
+        {"strip-only", no_argument, 0, OPT_STRIP_ONLY},
+        {"expand-only", no_argument, 0, OPT_EXPAND_ONLY},
+        {"system-headers", required_argument, 0, OPT_SYSTEM_HEADERS},
+        {"system-stubs", required_argument, 0, OPT_SYSTEM_STUBS},
+        {"unity", no_argument, 0, OPT_UNITY},
+        {"cache-dir", required_argument, 0, OPT_CACHE_DIR},
+        {"cache-max-bytes", required_argument, 0, OPT_CACHE_MAX_BYTES},
+        {"compact", no_argument, 0, OPT_COMPACT},
+        {"incremental", required_argument, 0, OPT_INCREMENTAL},
         {0, 0, 0, 0}};
 
     // Elabora le opzioni della riga di comando
@@ -115,47 +244,287 @@ int parse_arguments(int argc, char *argv[], PreCompiler *compiler)
         case 'v':
             compiler->verbose = true;
             break;
+        case OPT_DIAG_FORMAT:
+            if (diag_parse_format(optarg, &compiler->diagnostics.format) != 0)
+            {
+                fprintf(stderr, "Errore: formato di diagnostica sconosciuto %s (table, line, json)\n", optarg);
+                return 1;
+            }
+            diagnostics_requested = true;
+            break;
+        case OPT_DIAG_OUT:
+            free(compiler->diagnostics.filename);
+            compiler->diagnostics.filename = strdup(optarg);
+            diagnostics_requested = true;
+            break;
+        case OPT_MAX_ERRORS:
+            if (parse_count("max-errors", optarg, INT_MAX, &value) != 0)
+                return 1;
+            compiler->diagnostics.max_errors = (int)value;
+            break;
+        case OPT_SUMMARY_ONLY:
+            compiler->diagnostics.summary_only = true;
+            break;
+        case OPT_IF_CHANGED:
+            compiler->only_if_changed = true;
+            break;
+        case OPT_INCLUDE_REPORT:
+            compiler->include_report = true;
+            break;
+        case OPT_INCLUDE_FOLDED:
+            free(compiler->include_folded_filename);
+            compiler->include_folded_filename = strdup(optarg);
+            break;
+        case OPT_METRICS_FILE:
+            free(compiler->metrics_filename);
+            compiler->metrics_filename = strdup(optarg);
+            break;
+        case OPT_PIPELINE:
+            compiler->pipelined = true;
+            break;
+        case OPT_SYSTEM_HEADERS:
+            if (strcmp(optarg, "expand") == 0)
+                compiler->system_headers = SYSTEM_HEADERS_EXPAND;
+            else if (strcmp(optarg, "keep") == 0)
+                compiler->system_headers = SYSTEM_HEADERS_KEEP;
+            else if (strcmp(optarg, "stub") == 0)
+                compiler->system_headers = SYSTEM_HEADERS_STUB;
+            else
+            {
+                fprintf(stderr, "Errore: modalità non valida per --system-headers: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_SYSTEM_STUBS:
+            // L'elenco implica la modalità stub
+            if (strset_add_list(&compiler->system_stubs, optarg) != 0)
+            {
+                fprintf(stderr, "Errore: impossibile allocare memoria per l'elenco degli stub\n");
+                return 1;
+            }
+            compiler->system_headers = SYSTEM_HEADERS_STUB;
+            break;
+        case OPT_UNITY:
+            compiler->unity = true;
+            break;
+        case OPT_CHECK_ONLY:
+        case OPT_STRIP_ONLY:
+        case OPT_EXPAND_ONLY:
+            if (compiler->passes != PASS_ALL)
+            {
+                fprintf(stderr, "Errore: --check-only, --strip-only e --expand-only sono alternative\n");
+                return 1;
+            }
+            compiler->passes = option == OPT_CHECK_ONLY   ? PASS_INCLUDES | PASS_COMMENTS | PASS_CHECK
+                               : option == OPT_STRIP_ONLY ? PASS_COMMENTS | PASS_OUTPUT
+                                                          : PASS_INCLUDES | PASS_OUTPUT;
+            break;
+        case OPT_TRACE:
+            free(compiler->trace_filename);
+            compiler->trace_filename = strdup(optarg);
+            break;
+        case OPT_INCREMENTAL:
+            free(compiler->incremental_filename);
+            compiler->incremental_filename = strdup(optarg);
+            break;
+        case OPT_COMPACT:
+            compiler->compact = true;
+            break;
+        case OPT_CACHE_DIR:
+            free(compiler->cache_dir);
+            compiler->cache_dir = strdup(optarg);
+            break;
+        case OPT_CACHE_MAX_BYTES:
+            if (parse_count("cache-max-bytes", optarg, LLONG_MAX, &value) != 0)
+                return 1;
+            compiler->cache_max_bytes = value;
+            break;
+        case OPT_MAX_INCLUDE_DEPTH:
+            if (parse_count("max-include-depth", optarg, INT_MAX, &value) != 0)
+                return 1;
+            compiler->limits.max_include_depth = (int)value;
+            break;
+        case OPT_MAX_INCLUDES:
+            if (parse_count("max-includes", optarg, INT_MAX, &value) != 0)
+                return 1;
+            compiler->limits.max_includes = (int)value;
+            break;
+        case OPT_MAX_EXPANDED_BYTES:
+            if (parse_count("max-expanded-bytes", optarg, LLONG_MAX, &value) != 0)
+                return 1;
+            compiler->limits.max_expanded_bytes = value;
+            break;
+        case OPT_TIME_BUDGET:
+            // Il limite di tempo è espresso in millisecondi
+            if (parse_count("time-budget", optarg, LLONG_MAX / 1000000, &value) != 0)
+                return 1;
+            compiler->limits.time_budget_ns = (uint64_t)value * 1000000ull;
+            break;
         default:
             fprintf(stderr, "Opzione sconosciuta: %c\n", option);
             return 1;
         }
     }
 
+    // Con --unity gli argomenti rimanenti sono ulteriori file di input
+    if (compiler->unity && !compiler->input_filename && optind < argc)
+        compiler->input_filename = strdup(argv[optind++]);
+
     // Verifica che sia stato specificato un file di input
     if (!compiler->input_filename)
     {
         fprintf(stderr, "Errore: il file di input è obbligatorio\n");
-        fprintf(stderr, "Uso: %s [-i|--in file_input] [-o|--out file_output] [-v|--verbose]\n", argv[0]);
+        fprintf(stderr, "Uso: %s [-i|--in file_input] [-o|--out file_output] [-v|--verbose]\n"
+                        "       [--diag-format table|line|json] [--diag-out file] [--max-errors N] [--summary-only]\n"
+                        "       [--if-changed] [--include-report] [--include-folded file]\n"
+                        "       [--metrics-file file.prom] [--max-include-depth N] [--max-includes N]\n"
+                        "       [--max-expanded-bytes N] [--time-budget ms] [--trace file.json]\n"
+                        "       [--pipeline] [--check-only|--strip-only|--expand-only]\n"
+                        "       [--system-headers expand|keep|stub] [--system-stubs h1,h2,...]\n"
+                        "       [--unity file_input...] [--cache-dir dir] [--cache-max-bytes N]\n"
+                        "       [--compact] [--incremental file]\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (compiler->system_headers == SYSTEM_HEADERS_STUB && compiler->system_stubs.count == 0 &&
+        strset_add_list(&compiler->system_stubs, default_system_stubs) != 0)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'elenco degli stub\n");
+        return 1;
+    }
+
+    if (compiler->unity)
+    {
+        if (compiler->pipelined)
+        {
+            fprintf(stderr, "Errore: --pipeline non si può usare con --unity\n");
+            return 1;
+        }
+        compiler->unit_count = 1 + (argc - optind);
+        compiler->units = (TranslationUnit *)calloc(compiler->unit_count, sizeof(TranslationUnit));
+        if (!compiler->units)
+        {
+            fprintf(stderr, "Errore: impossibile allocare memoria per le unità di compilazione\n");
+            compiler->unit_count = 0;
+            return 1;
+        }
+        for (int i = 0; i < compiler->unit_count; i++)
+        {
+            compiler->units[i].filename = strdup(i == 0 ? compiler->input_filename : argv[optind + i - 1]);
+            if (!compiler->units[i].filename)
+            {
+                fprintf(stderr, "Errore: impossibile allocare memoria per le unità di compilazione\n");
+                return 1;
+            }
+        }
+    }
+
+    // La pipeline a thread esegue sempre tutti i passi
+    if (compiler->pipelined && compiler->passes != PASS_ALL)
+    {
+        fprintf(stderr, "Errore: --pipeline non si può usare con --check-only, --strip-only o --expand-only\n");
         return 1;
     }
 
+    // La compattazione avviene durante la rimozione dei commenti
+    if (compiler->compact && !(compiler->passes & PASS_COMMENTS))
+    {
+        fprintf(stderr, "Errore: --compact non si può usare con --expand-only\n");
+        return 1;
+    }
+
+    // I checkpoint descrivono un'elaborazione sequenziale completa di un singolo file
+    if (compiler->incremental_filename &&
+        (compiler->pipelined || compiler->unity || compiler->compact || compiler->passes != PASS_ALL ||
+         compiler->diagnostics.max_errors > 0))
+    {
+        fprintf(stderr, "Errore: --incremental non si può usare con --pipeline, --unity, --compact, "
+                        "--max-errors, --check-only, --strip-only o --expand-only\n");
+        return 1;
+    }
+
+    // La diagnostica viene scritta con --verbose, se richiesta esplicitamente
+    // o se è l'unico risultato dell'elaborazione
+    compiler->diagnostics.enabled = compiler->verbose || diagnostics_requested || !(compiler->passes & PASS_OUTPUT);
+
     return 0;
 }
 
-// Funzione per leggere il contenuto di un file
-char *read_file_content(const char *filename, int *size, int *lines)
+// Dimensione iniziale del buffer di lettura
+#define READ_CHUNK_SIZE (64 * 1024)
+
+// Legge uno stream fino alla fine con un buffer che raddoppia quando è pieno,
+// così funziona anche con pipe e dispositivi di cui non si conosce la dimensione
+static char *read_stream(FILE *file, size_t *size)
 {
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t len = 0;
+    char *buffer = (char *)malloc(capacity + 1);
+    if (!buffer)
+        return NULL;
+
+    size_t n;
+    while ((n = fread(buffer + len, 1, capacity - len, file)) > 0)
     {
-        fprintf(stderr, "Errore: impossibile aprire il file %s\n", filename);
+        len += n;
+        if (len == capacity)
+        {
+            capacity *= 2;
+            char *new_buffer = (char *)realloc(buffer, capacity + 1);
+            if (!new_buffer)
+            {
+                free(buffer);
+                return NULL;
+            }
+            buffer = new_buffer;
+        }
+    }
+    if (ferror(file))
+    {
+        free(buffer);
         return NULL;
     }
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    buffer[len] = '\0';
+    *size = len;
+    return buffer;
+}
 
-    char *content = (char *)malloc(file_size + 1);
-    if (!content)
+// Funzione per leggere il contenuto di un file
+char *read_file_content(PreCompiler *compiler, const char *filename, int *size, int *lines)
+{
+    char *content;
+    size_t read_size;
+
+    Codec codec = codec_from_filename(filename);
+    if (codec != CODEC_NONE)
     {
-        fprintf(stderr, "Errore: impossibile allocare memoria per il contenuto del file\n");
-        fclose(file);
-        return NULL;
+        // I file .gz e .zst vengono decompressi in streaming durante la lettura
+        content = read_compressed_file(filename, codec, &read_size);
+        if (!content)
+            return NULL;
     }
+    else
+    {
+        // "-" indica stdin
+        bool from_stdin = strcmp(filename, "-") == 0;
+        FILE *file = from_stdin ? stdin : fopen(filename, "r");
+        if (!file)
+        {
+            fprintf(stderr, "Errore: impossibile aprire il file %s\n", filename);
+            return NULL;
+        }
 
-    size_t read_size = fread(content, 1, file_size, file);
-    content[read_size] = '\0';
+        content = read_stream(file, &read_size);
+        if (!from_stdin)
+            fclose(file);
+        if (!content)
+        {
+            fprintf(stderr, "Errore: impossibile leggere il file %s\n", filename);
+            return NULL;
+        }
+    }
 
     int line_count = 0;
     for (size_t i = 0; i < read_size; i++)
@@ -171,22 +540,178 @@ char *read_file_content(const char *filename, int *size, int *lines)
         line_count++;
     }
 
+    // Segnala la prima sequenza UTF-8 non valida; l'elaborazione prosegue
+    size_t error_offset;
+    if (!utf8_validate(content, read_size, &error_offset))
+    {
+        int error_line = 1;
+        for (size_t i = 0; i < error_offset; i++)
+        {
+            if (content[i] == '\n')
+                error_line++;
+        }
+        char message[PATH_MAX + 96];
+        snprintf(message, sizeof(message), "Avviso: sequenza UTF-8 non valida in %s all'offset %zu (riga %d)",
+                 filename, error_offset, error_line);
+        fprintf(stderr, "%s\n", message);
+        if (compiler->cache)
+            cache_record_warning(compiler->cache, message);
+    }
+
     if (size)
         *size = (int)read_size;
     if (lines)
         *lines = line_count;
 
-    fclose(file);
     return content;
 }
 
+// Restituisce il nome di una fase dell'elaborazione
+const char *stage_name(Stage stage)
+{
+    static const char *names[STAGE_COUNT] = {"read", "includes", "comments", "check", "write"};
+    return stage < STAGE_COUNT ? names[stage] : "unknown";
+}
+
+// Restituisce il tempo di un orologio monotono in nanosecondi
+uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Conta i byte che restano di un testo dopo la rimozione dei commenti
+static int count_stripped_bytes(const char *content, int size)
+{
+    char *scratch = (char *)malloc((size_t)size + 1);
+    if (!scratch)
+        return 0;
+    CommentState state = COMMENT_STATE_CODE;
+    size_t stripped = strip_comments(&state, content, (size_t)size, scratch, NULL);
+    stripped += strip_comments_finish(&state, scratch + stripped);
+    free(scratch);
+    return (int)stripped;
+}
+
+// Scrive il nome di un file come elemento della catena. Nel formato
+// folded-stack ';' separa i frame e lo spazio precede il conteggio: questi
+// caratteri, e gli a capo, vengono sostituiti con '_'
+static void write_chain_name(FILE *file, const char *name, bool folded)
+{
+    if (!folded)
+    {
+        fputs(name, file);
+        return;
+    }
+    for (const char *p = name; *p; p++)
+    {
+        bool separator = *p == ';' || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r';
+        fputc(separator ? '_' : *p, file);
+    }
+}
+
+// Scrive la catena di inclusione che porta al file con l'indice dato
+static void write_include_chain(FILE *file, const PreCompiler *compiler, int index, const char *separator, bool folded)
+{
+    if (index < 0)
+    {
+        write_chain_name(file, compiler->input_filename, folded);
+        return;
+    }
+    write_include_chain(file, compiler, compiler->included_files[index]->parent, separator, folded);
+    fputs(separator, file);
+    write_chain_name(file, compiler->included_files[index]->filename, folded);
+}
+
+// Segnala il superamento di un limite indicando la catena di inclusione corrente
+static void report_limit_exceeded(PreCompiler *compiler, const char *message, long long limit, const char *next)
+{
+    fprintf(stderr, "Errore: %s (limite %lld)\n  catena di inclusione: ", message, limit);
+    write_include_chain(stderr, compiler, compiler->current_include, " -> ", false);
+    if (next)
+        fprintf(stderr, " -> %s", next);
+    fputc('\n', stderr);
+    compiler->aborted = true;
+}
+
+// Verifica il limite di tempo; se è superato segnala l'errore e interrompe l'elaborazione
+bool time_budget_exceeded(PreCompiler *compiler, const char *where)
+{
+    if (compiler->aborted)
+        return true;
+    if (compiler->deadline_ns == 0 || monotonic_ns() <= compiler->deadline_ns)
+        return false;
+
+    char message[128];
+    snprintf(message, sizeof(message), "tempo massimo di elaborazione superato durante %s", where);
+    report_limit_exceeded(compiler, message, (long long)(compiler->limits.time_budget_ns / 1000000), NULL);
+    return true;
+}
+
+// Conta i byte prodotti dall'espansione e verifica i limiti di dimensione e tempo
+static bool account_expanded_bytes(PreCompiler *compiler, size_t len)
+{
+    long long before = compiler->expanded_bytes;
+    compiler->expanded_bytes += (long long)len;
+
+    if (compiler->limits.max_expanded_bytes > 0 && compiler->expanded_bytes > compiler->limits.max_expanded_bytes)
+    {
+        report_limit_exceeded(compiler, "dimensione massima dell'espansione degli #include superata",
+                              compiler->limits.max_expanded_bytes, NULL);
+        return false;
+    }
+    // L'orologio viene letto solo ogni 64 KiB prodotti
+    if ((before >> 16) != (compiler->expanded_bytes >> 16) && time_budget_exceeded(compiler, "l'espansione degli #include"))
+        return false;
+    return true;
+}
+
+// Aggiunge un blocco al risultato dell'espansione. Se è registrato un
+// consumatore (include_sink) il blocco gli viene passato subito e il risultato
+// resta vuoto, così l'output può essere elaborato mentre l'espansione prosegue.
+static bool append_expanded(PreCompiler *compiler, char **result, size_t *result_len, size_t *result_capacity,
+                            const char *data, size_t len)
+{
+    if (len == 0)
+        return true;
+
+    if (compiler->include_sink)
+    {
+        if (compiler->include_sink(compiler->include_sink_context, data, len) != 0)
+        {
+            compiler->aborted = true;
+            return false;
+        }
+        return true;
+    }
+
+    if (*result_len + len + 1 > *result_capacity)
+    {
+        *result_capacity = (*result_len + len) * 2;
+        char *new_result = (char *)realloc(*result, *result_capacity);
+        if (!new_result)
+        {
+            fprintf(stderr, "Errore: impossibile riallocare memoria per il risultato\n");
+            return false;
+        }
+        *result = new_result;
+    }
+
+    memcpy(*result + *result_len, data, len);
+    *result_len += len;
+    (*result)[*result_len] = '\0';
+    return true;
+}
+
 // Risolve gli #include
 char *resolve_includes(const char *content, PreCompiler *compiler)
 {
     if (!content)
         return NULL;
 
-    size_t result_capacity = strlen(content);
+    // Con un consumatore registrato il risultato resta vuoto
+    size_t result_capacity = compiler->include_sink ? 0 : strlen(content);
     char *result = (char *)malloc(result_capacity + 1);
     if (!result)
     {
@@ -196,10 +721,10 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
     result[0] = '\0';
 
     // Preparazione per l'array di file inclusi
-    int included_files_capacity = 1;
     if (compiler->included_files == NULL)
     {
-        compiler->included_files = (IncludedFile **)malloc(included_files_capacity * sizeof(IncludedFile *));
+        compiler->included_files_capacity = 1;
+        compiler->included_files = (IncludedFile **)malloc(compiler->included_files_capacity * sizeof(IncludedFile *));
         if (!compiler->included_files)
         {
             fprintf(stderr, "Errore: impossibile allocare memoria per i file inclusi\n");
@@ -207,6 +732,7 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
             return NULL;
         }
     }
+    int depth = compiler->current_include < 0 ? 1 : compiler->included_files[compiler->current_include]->depth + 1;
 
     const char *ptr = content;
     size_t result_len = 0;
@@ -233,14 +759,29 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
             // Trova il nome del file tra virgolette o parentesi angolari
             const char *include_start = strpbrk(line_start, "\"<");
             const char *include_end = NULL;
+            bool system_header = false;
 
             if (include_start)
             {
+                system_header = *include_start == '<';
                 include_start++; // Salta la virgoletta o parentesi angolare iniziale
                 include_end = strpbrk(include_start, "\">");
             }
 
-            if (include_start && include_end)
+            // Gli header di sistema vengono lasciati invariati o rimossi senza accedere al filesystem
+            bool passthrough = false;
+            if (system_header && include_end && compiler->system_headers != SYSTEM_HEADERS_EXPAND)
+            {
+                if (compiler->system_headers == SYSTEM_HEADERS_STUB &&
+                    strset_contains(&compiler->system_stubs, include_start, include_end - include_start))
+                {
+                    ptr = line_end;
+                    continue;
+                }
+                passthrough = true;
+            }
+
+            if (include_start && include_end && !passthrough)
             {
                 // Estrai il nome del file
                 size_t filename_len = include_end - include_start;
@@ -261,6 +802,7 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
                 {
                     if (strcmp(compiler->included_files[i]->filename, include_filename) == 0)
                     {
+                        compiler->included_files[i]->requests++;
                         already_included = true;
                         break;
                     }
@@ -268,16 +810,35 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
 
                 if (!already_included)
                 {
-                    // Legge il contenuto del file incluso
+                    // Verifica i limiti prima di aprire un nuovo file
+                    if (compiler->limits.max_include_depth > 0 && depth > compiler->limits.max_include_depth)
+                        report_limit_exceeded(compiler, "profondità massima degli #include superata",
+                                              compiler->limits.max_include_depth, include_filename);
+                    else if (compiler->limits.max_includes > 0 && compiler->stats.files_included >= compiler->limits.max_includes)
+                        report_limit_exceeded(compiler, "numero massimo di file inclusi superato",
+                                              compiler->limits.max_includes, include_filename);
+                    if (compiler->aborted || time_budget_exceeded(compiler, "l'espansione degli #include"))
+                    {
+                        free(include_filename);
+                        free(result);
+                        return NULL;
+                    }
+
+                    // Legge il contenuto del file incluso, misurandone il costo
+                    trace_begin("include", include_filename);
+                    if (myprecompiler_include__open_ENABLED())
+                        PROBE2(include__open, include_filename, depth);
+                    uint64_t start_ns = monotonic_ns();
                     int file_size, file_lines;
-                    char *include_content = read_file_content(include_filename, &file_size, &file_lines);
+                    char *include_content = read_file_content(compiler, include_filename, &file_size, &file_lines);
                     if (include_content)
                     {
                         // Aggiunge una nuova IncludedFile alla struttura
-                        if (compiler->stats.files_included >= included_files_capacity)
+                        uint64_t read_ns = monotonic_ns() - start_ns;
+                        if (compiler->stats.files_included >= compiler->included_files_capacity)
                         {
-                            included_files_capacity *= 2;
-                            IncludedFile **new_included_files = (IncludedFile **)realloc(compiler->included_files, included_files_capacity * sizeof(IncludedFile *));
+                            compiler->included_files_capacity *= 2;
+                            IncludedFile **new_included_files = (IncludedFile **)realloc(compiler->included_files, compiler->included_files_capacity * sizeof(IncludedFile *));
                             if (!new_included_files)
                             {
                                 fprintf(stderr, "Errore: impossibile riallocare memoria per i file inclusi\n");
@@ -302,39 +863,54 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
                         included_file->filename = include_filename;
                         included_file->size = file_size;
                         included_file->lines = file_lines;
-                        compiler->included_files[compiler->stats.files_included++] = included_file;
+                        included_file->requests = 1;
+                        included_file->stripped_size = compiler->include_report || compiler->include_folded_filename
+                                                           ? count_stripped_bytes(include_content, file_size)
+                                                           : 0;
+                        included_file->depth = depth;
+                        included_file->parent = compiler->current_include;
+                        included_file->read_ns = read_ns;
+                        included_file->total_ns = 0;
+                        int included_index = compiler->stats.files_included++;
+                        compiler->included_files[included_index] = included_file;
 
                         // Elabora ricorsivamente il contenuto del file incluso per gestire gli include nidificati
+                        int parent_include = compiler->current_include;
+                        compiler->current_include = included_index;
                         char *processed_include_content = resolve_includes(include_content, compiler);
+                        compiler->current_include = parent_include;
+                        compiler->included_files[included_index]->total_ns = monotonic_ns() - start_ns;
+                        if (myprecompiler_include__close_ENABLED())
+                            PROBE3(include__close, include_filename,
+                                   processed_include_content ? strlen(processed_include_content) : 0,
+                                   compiler->included_files[included_index]->total_ns);
+                        trace_end();
                         if (processed_include_content)
                         {
                             // Aggiunge il contenuto processato al risultato
-                            size_t content_len = strlen(processed_include_content);
-                            if (result_len + content_len + 1 > result_capacity)
+                            if (!append_expanded(compiler, &result, &result_len, &result_capacity,
+                                                 processed_include_content, strlen(processed_include_content)))
                             {
-                                result_capacity = (result_len + content_len) * 2;
-                                char *new_result = (char *)realloc(result, result_capacity);
-                                if (!new_result)
-                                {
-                                    fprintf(stderr, "Errore: impossibile riallocare memoria per il risultato\n");
-                                    free(processed_include_content);
-                                    free(include_content);
-                                    free(result);
-                                    return NULL;
-                                }
-                                result = new_result;
+                                free(processed_include_content);
+                                free(include_content);
+                                free(result);
+                                return NULL;
                             }
-
-                            strcpy(result + result_len, processed_include_content);
-                            result_len += content_len;
-
                             free(processed_include_content);
                         }
                         free(include_content);
+                        if (compiler->aborted)
+                        {
+                            // Un limite è stato superato in un file annidato
+                            free(result);
+                            return NULL;
+                        }
                     }
                     else
                     {
+                        trace_end();
                         fprintf(stderr, "Avviso: impossibile includere il file %s\n", include_filename);
+                        compiler->missing_includes++;
                         free(include_filename);
                     }
                 }
@@ -346,46 +922,34 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
             }
             else
             {
-                // Copia la linea originale se il formato è errato
+                // Copia la linea originale se il formato è errato o se è un header di sistema lasciato invariato
                 size_t line_len = line_end - line_start;
-                if (result_len + line_len + 1 > result_capacity)
+                if (!account_expanded_bytes(compiler, line_len))
                 {
-                    result_capacity = (result_len + line_len) * 2;
-                    char *new_result = (char *)realloc(result, result_capacity);
-                    if (!new_result)
-                    {
-                        fprintf(stderr, "Errore: impossibile riallocare memoria per il risultato\n");
-                        free(result);
-                        return NULL;
-                    }
-                    result = new_result;
+                    free(result);
+                    return NULL;
+                }
+                if (!append_expanded(compiler, &result, &result_len, &result_capacity, line_start, line_len))
+                {
+                    free(result);
+                    return NULL;
                 }
-
-                strncpy(result + result_len, line_start, line_len);
-                result_len += line_len;
-                result[result_len] = '\0';
             }
         }
         else
         {
             // Copia la linea originale
             size_t line_len = line_end - line_start;
-            if (result_len + line_len + 1 > result_capacity)
+            if (!account_expanded_bytes(compiler, line_len))
             {
-                result_capacity = (result_len + line_len) * 2;
-                char *new_result = (char *)realloc(result, result_capacity);
-                if (!new_result)
-                {
-                    fprintf(stderr, "Errore: impossibile riallocare memoria per il risultato\n");
-                    free(result);
-                    return NULL;
-                }
-                result = new_result;
+                free(result);
+                return NULL;
+            }
+            if (!append_expanded(compiler, &result, &result_len, &result_capacity, line_start, line_len))
+            {
+                free(result);
+                return NULL;
             }
-
-            strncpy(result + result_len, line_start, line_len);
-            result_len += line_len;
-            result[result_len] = '\0';
         }
 
         ptr = line_end;
@@ -394,6 +958,26 @@ char *resolve_includes(const char *content, PreCompiler *compiler)
     return result;
 }
 
+// Riceve ogni nome dichiarato trovato dal parser e ne verifica la validità
+bool report_declared_name(void *context, const char *name, int line_number)
+{
+    PreCompiler *compiler = (PreCompiler *)context;
+
+    compiler->stats.checked_vars++;
+    if (!is_valid_name(name))
+    {
+        // Invia l'errore al sink senza conservarlo
+        InvalidVariable error = {compiler->input_filename, line_number, name};
+        compiler->stats.errors_detected++;
+        if (myprecompiler_invalid__name_ENABLED())
+            PROBE3(invalid__name, compiler->input_filename, line_number, name);
+        if (compiler->cache && !compiler->diagnostics.limit_reached)
+            cache_record_error(compiler->cache, line_number, name);
+        return diag_report(&compiler->diagnostics, &error);
+    }
+    return true;
+}
+
 // Controlla la validità degli identificatori di variabili
 char *check_variables_name(const char *content, PreCompiler *compiler)
 {
@@ -408,155 +992,221 @@ char *check_variables_name(const char *content, PreCompiler *compiler)
         return NULL;
     }
 
-    // Preparazione per l'array di errori
-    compiler->errors = (InvalidVariable **)malloc(sizeof(InvalidVariable *));
-    if (!compiler->errors)
+    // Analizza le dichiarazioni (variabili, parametri, membri, dichiarazioni multiple)
+    // in un'unica passata in avanti
+    if (!compiler->diagnostics.limit_reached)
     {
-        fprintf(stderr, "Errore: impossibile allocare memoria per gli errori\n");
-        free(result);
-        return NULL;
+        DeclScanner scanner;
+        decl_scanner_init(&scanner, report_declared_name, compiler);
+        if (decl_scanner_feed(&scanner, content, strlen(content)))
+            decl_scanner_finish(&scanner);
+        decl_scanner_free(&scanner);
     }
 
-    // Analizza il codice riga per riga per trovare dichiarazioni di variabili
-    int line_number = 1;
-    const char *ptr = content;  
-    bool has_previous_line_ended = true;
-    bool is_in_braces = false;
-    
-    while (*ptr)
-    {
-        
-        // Se troviamo un newline, incrementiamo il contatore di righe                        
-        if (*ptr == '\n') {
-            line_number++;
-        } else if (*ptr == ';' || *ptr == '{' || *ptr == '}') {
-            // Gestione di fine riga con punto e virgola e parentesi graffa
-            has_previous_line_ended = true;
-        } else if (*ptr == '(') {
-            // Se troviamo una parentesi aperta, impostiamo il flag per indicare che siamo all'interno di una parentesi
-            is_in_braces = true;
-        }
+    return result;
+}
 
-        // Cerca dichiarazioni di variabili se la riga precedente è terminata        
-        if ((isalpha((unsigned char)*ptr)) && has_previous_line_ended)
-        {
-            // Cerca il tipo (int, char, float, ecc.)
-            const char *type_start = ptr;
-            while (isalnum((unsigned char)*ptr)) {
-                ptr++;    
-                if (*ptr == '\n') {
-                    line_number++;
-                }
-            }
+// Classi di caratteri riconosciute dall'automa dei commenti
+enum
+{
+    CC_OTHER,     // Qualsiasi altro carattere
+    CC_SLASH,     // '/'
+    CC_STAR,      // '*'
+    CC_NEWLINE,   // '\n'
+    CC_BACKSLASH, // '\\'
+    CC_DQUOTE,    // '"'
+    CC_SQUOTE,    // '\''
+    CC_COUNT
+};
+
+// Transizione dell'automa: stato successivo e azioni da eseguire
+typedef struct
+{
+    uint8_t next;  // Stato successivo
+    uint8_t emit;  // 1 se il carattere corrente va copiato nell'output
+    uint8_t pre;   // 1 se prima va emesso il '/' rimasto in sospeso
+    uint8_t count; // 1 se si conta una riga di commento eliminata
+    uint8_t probe; // Probe da attivare: 1/2 inizio di commento // o /* */, 3 fine
+} CommentTransition;
+
+// Mappa ogni byte alla sua classe
+static const uint8_t comment_char_class[256] = {
+    ['/'] = CC_SLASH,
+    ['*'] = CC_STAR,
+    ['\n'] = CC_NEWLINE,
+    ['\\'] = CC_BACKSLASH,
+    ['"'] = CC_DQUOTE,
+    ['\''] = CC_SQUOTE,
+};
+
+#define KEEP(state) {state, 1, 0, 0, 0}
+#define DROP(state) {state, 0, 0, 0, 0}
+
+// Tabella delle transizioni, indicizzata per [stato][classe]
+static const CommentTransition comment_transitions[COMMENT_STATE_COUNT][CC_COUNT] = {
+    [COMMENT_STATE_CODE] = {
+        [CC_OTHER] = KEEP(COMMENT_STATE_CODE),
+        [CC_SLASH] = DROP(COMMENT_STATE_SLASH),
+        [CC_STAR] = KEEP(COMMENT_STATE_CODE),
+        [CC_NEWLINE] = KEEP(COMMENT_STATE_CODE),
+        [CC_BACKSLASH] = KEEP(COMMENT_STATE_CODE),
+        [CC_DQUOTE] = KEEP(COMMENT_STATE_STRING),
+        [CC_SQUOTE] = KEEP(COMMENT_STATE_CHAR),
+    },
+    // Un '/' in sospeso: se non inizia un commento viene emesso insieme al carattere corrente
+    [COMMENT_STATE_SLASH] = {
+        [CC_OTHER] = {COMMENT_STATE_CODE, 1, 1, 0, 0},
+        [CC_SLASH] = {COMMENT_STATE_LINE, 0, 0, 1, 1},
+        [CC_STAR] = {COMMENT_STATE_BLOCK, 0, 0, 0, 2},
+        [CC_NEWLINE] = {COMMENT_STATE_CODE, 1, 1, 0, 0},
+        [CC_BACKSLASH] = {COMMENT_STATE_CODE, 1, 1, 0, 0},
+        [CC_DQUOTE] = {COMMENT_STATE_STRING, 1, 1, 0, 0},
+        [CC_SQUOTE] = {COMMENT_STATE_CHAR, 1, 1, 0, 0},
+    },
+    [COMMENT_STATE_LINE] = {
+        [CC_OTHER] = DROP(COMMENT_STATE_LINE),
+        [CC_SLASH] = DROP(COMMENT_STATE_LINE),
+        [CC_STAR] = DROP(COMMENT_STATE_LINE),
+        [CC_NEWLINE] = {COMMENT_STATE_CODE, 1, 0, 0, 3},
+        [CC_BACKSLASH] = DROP(COMMENT_STATE_LINE_ESCAPE),
+        [CC_DQUOTE] = DROP(COMMENT_STATE_LINE),
+        [CC_SQUOTE] = DROP(COMMENT_STATE_LINE),
+    },
+    // Backslash in un commento di linea: se segue un newline il commento continua
+    [COMMENT_STATE_LINE_ESCAPE] = {
+        [CC_OTHER] = DROP(COMMENT_STATE_LINE),
+        [CC_SLASH] = DROP(COMMENT_STATE_LINE),
+        [CC_STAR] = DROP(COMMENT_STATE_LINE),
+        [CC_NEWLINE] = {COMMENT_STATE_LINE, 1, 0, 1, 0},
+        [CC_BACKSLASH] = DROP(COMMENT_STATE_LINE_ESCAPE),
+        [CC_DQUOTE] = DROP(COMMENT_STATE_LINE),
+        [CC_SQUOTE] = DROP(COMMENT_STATE_LINE),
+    },
+    [COMMENT_STATE_BLOCK] = {
+        [CC_OTHER] = DROP(COMMENT_STATE_BLOCK),
+        [CC_SLASH] = DROP(COMMENT_STATE_BLOCK),
+        [CC_STAR] = DROP(COMMENT_STATE_BLOCK_STAR),
+        [CC_NEWLINE] = {COMMENT_STATE_BLOCK, 1, 0, 1, 0},
+        [CC_BACKSLASH] = DROP(COMMENT_STATE_BLOCK),
+        [CC_DQUOTE] = DROP(COMMENT_STATE_BLOCK),
+        [CC_SQUOTE] = DROP(COMMENT_STATE_BLOCK),
+    },
+    // Un '*' in un commento di blocco: se segue '/' il commento termina
+    [COMMENT_STATE_BLOCK_STAR] = {
+        [CC_OTHER] = DROP(COMMENT_STATE_BLOCK),
+        [CC_SLASH] = {COMMENT_STATE_CODE, 0, 0, 1, 3},
+        [CC_STAR] = DROP(COMMENT_STATE_BLOCK_STAR),
+        [CC_NEWLINE] = {COMMENT_STATE_BLOCK, 1, 0, 1, 0},
+        [CC_BACKSLASH] = DROP(COMMENT_STATE_BLOCK),
+        [CC_DQUOTE] = DROP(COMMENT_STATE_BLOCK),
+        [CC_SQUOTE] = DROP(COMMENT_STATE_BLOCK),
+    },
+    // Stringa letterale: un newline non preceduto da backslash la chiude comunque
+    [COMMENT_STATE_STRING] = {
+        [CC_OTHER] = KEEP(COMMENT_STATE_STRING),
+        [CC_SLASH] = KEEP(COMMENT_STATE_STRING),
+        [CC_STAR] = KEEP(COMMENT_STATE_STRING),
+        [CC_NEWLINE] = KEEP(COMMENT_STATE_CODE),
+        [CC_BACKSLASH] = KEEP(COMMENT_STATE_STRING_ESCAPE),
+        [CC_DQUOTE] = KEEP(COMMENT_STATE_CODE),
+        [CC_SQUOTE] = KEEP(COMMENT_STATE_STRING),
+    },
+    [COMMENT_STATE_STRING_ESCAPE] = {
+        [CC_OTHER] = KEEP(COMMENT_STATE_STRING),
+        [CC_SLASH] = KEEP(COMMENT_STATE_STRING),
+        [CC_STAR] = KEEP(COMMENT_STATE_STRING),
+        [CC_NEWLINE] = KEEP(COMMENT_STATE_STRING),
+        [CC_BACKSLASH] = KEEP(COMMENT_STATE_STRING),
+        [CC_DQUOTE] = KEEP(COMMENT_STATE_STRING),
+        [CC_SQUOTE] = KEEP(COMMENT_STATE_STRING),
+    },
+    // Carattere letterale, gestito come la stringa
+    [COMMENT_STATE_CHAR] = {
+        [CC_OTHER] = KEEP(COMMENT_STATE_CHAR),
+        [CC_SLASH] = KEEP(COMMENT_STATE_CHAR),
+        [CC_STAR] = KEEP(COMMENT_STATE_CHAR),
+        [CC_NEWLINE] = KEEP(COMMENT_STATE_CODE),
+        [CC_BACKSLASH] = KEEP(COMMENT_STATE_CHAR_ESCAPE),
+        [CC_DQUOTE] = KEEP(COMMENT_STATE_CHAR),
+        [CC_SQUOTE] = KEEP(COMMENT_STATE_CODE),
+    },
+    [COMMENT_STATE_CHAR_ESCAPE] = {
+        [CC_OTHER] = KEEP(COMMENT_STATE_CHAR),
+        [CC_SLASH] = KEEP(COMMENT_STATE_CHAR),
+        [CC_STAR] = KEEP(COMMENT_STATE_CHAR),
+        [CC_NEWLINE] = KEEP(COMMENT_STATE_CHAR),
+        [CC_BACKSLASH] = KEEP(COMMENT_STATE_CHAR),
+        [CC_DQUOTE] = KEEP(COMMENT_STATE_CHAR),
+        [CC_SQUOTE] = KEEP(COMMENT_STATE_CHAR),
+    },
+};
+
+#undef KEEP
+#undef DROP
+
+// Elabora un blocco di input con l'automa dei commenti.
+// L'output deve avere spazio per almeno len + 1 byte e non può coincidere con
+// l'input: il '/' in sospeso dal blocco precedente lo fa avanzare di un byte
+// oltre la posizione di lettura. Restituisce i byte scritti.
+size_t strip_comments(CommentState *state, const char *input, size_t len, char *output, int *comment_lines)
+{
+    uint8_t current = (uint8_t)*state;
+    size_t out_len = 0;
+    int lines = 0;
 
-            // Estrae il tipo
-            size_t type_len = ptr - type_start;
-            char type_name[64] = {0};
-            if (type_len < sizeof(type_name))
-            {
-                strncpy(type_name, type_start, type_len);
-                type_name[type_len] = '\0';
-                
-                // Verifica se è un tipo C comune
-                if (strcmp(type_name, "int") == 0 ||
-                    strcmp(type_name, "char") == 0 ||
-                    strcmp(type_name, "float") == 0 ||
-                    strcmp(type_name, "double") == 0 ||
-                    strcmp(type_name, "void") == 0 ||
-                    strcmp(type_name, "long") == 0 ||
-                    strcmp(type_name, "short") == 0 ||
-                    strcmp(type_name, "unsigned") == 0 ||
-                    strcmp(type_name, "signed") == 0 ||
-                    strcmp(type_name, "struct") == 0 ||
-                    strcmp(type_name, "enum") == 0 ||
-                    strcmp(type_name, "union") == 0)
-                {
-                    // Cerca le variabili
-                    bool multiple_variables = false;
-                    do {
-                        multiple_variables = false;
-                        // Salta spazi bianchi dopo il tipo
-                        while (isspace((unsigned char)*ptr) || *ptr == '*') {
-                            ptr++;                            
-                            if (*ptr == '\n') {
-                                line_number++;
-                            } 
-                        }
-                        // Inizio del nome della variabile
-                        const char *var_start = ptr;
-
-                        // Raccogli tutti i caratteri che potrebbero far parte del nome
-                        // Include caratteri non validi per evidenziare gli errori
-                        while (*ptr && *ptr != ',' && *ptr != ';' && *ptr != '=' && *ptr != '(' && *ptr != '[' && *ptr != ']'){ 
-                            if (*(ptr + 1) == ',') {
-                                multiple_variables = true;
-                            }
-                            if (*ptr == ')' && is_in_braces) {
-                                ptr--;
-                                is_in_braces = false;
-                                break;
-                            } else {
-                                ptr++;
-                            }
-                            if (*ptr == '\n') {
-                                line_number++;
-                            } 
-                            
-                        }
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t c = (uint8_t)input[i];
+        CommentTransition t = comment_transitions[current][comment_char_class[c]];
+
+        // Scrive sempre, senza salti: '/' in sospeso (se pre) e poi il carattere,
+        // avanzando solo dei byte effettivamente emessi
+        output[out_len] = (char)(c ^ ((c ^ '/') & (uint8_t)-t.pre));
+        output[out_len + t.pre] = (char)c;
+        out_len += t.pre + t.emit;
+        lines += t.count;
+        current = t.next;
+    }
 
-                        // Estrae il nome della variabile
-                        size_t var_len = ptr - var_start;
-                        char var_name[256] = {0};
-                        
-                        if (var_len > 0 && var_len < sizeof(var_name))
-                        {
-                            strncpy(var_name, var_start, var_len);
-                            
-                            var_name[var_len] = '\0';
+    *state = (CommentState)current;
+    if (comment_lines)
+        *comment_lines += lines;
+    return out_len;
+}
 
-                            compiler->stats.checked_vars++;
-                            
-                            if (!is_valid_name(var_name))
-                            {
-                                // Aggiunge un errore
-                                InvalidVariable **new_errors = (InvalidVariable **)realloc(compiler->errors, (compiler->stats.errors_detected + 1) * sizeof(InvalidVariable *));
-                                if (!new_errors)
-                                {
-                                    fprintf(stderr, "Errore: impossibile riallocare memoria per gli errori\n");
-                                    free(result);
-                                    return NULL;
-                                }
-                                compiler->errors = new_errors;
-                                
-
-                                InvalidVariable *error = (InvalidVariable *)malloc(sizeof(InvalidVariable));
-                                if (!error)
-                                {
-                                    fprintf(stderr, "Errore: impossibile allocare memoria per l'errore\n");
-                                    free(result);
-                                    return NULL;
-                                }
-                                error->filename = strdup(compiler->input_filename);
-                                error->line_number = line_number;
-                                error->var_name = strdup(var_name);
-                                compiler->errors[compiler->stats.errors_detected++] = error;
-                            }
-                            has_previous_line_ended = !multiple_variables;
-                        }
-                        if (*ptr && multiple_variables)
-                            ptr++;
-                    } while (multiple_variables);
-                }   
-            }
-        }
-        // Passa al carattere successivo
-        if (*ptr)
-            ptr++;
+// Attiva i probe comment__start e comment__end per un blocco che inizia alla
+// posizione offset del testo espanso, nello stato state. L'automa viene
+// ripercorso solo se un tracer è agganciato: il ciclo di strip_comments resta senza salti.
+void comment_probes(CommentState state, const char *input, size_t len, size_t offset)
+{
+    if (!myprecompiler_comment__start_ENABLED() && !myprecompiler_comment__end_ENABLED())
+        return;
+
+    uint8_t current = (uint8_t)state;
+    for (size_t i = 0; i < len; i++)
+    {
+        CommentTransition t = comment_transitions[current][comment_char_class[(uint8_t)input[i]]];
+        if (t.probe == 3)
+            PROBE1(comment__end, offset + i);
+        else if (t.probe)
+            PROBE2(comment__start, offset + i, t.probe);
+        current = t.next;
     }
+}
 
-    return result;
+// Completa l'elaborazione alla fine dell'input, emettendo un eventuale '/' in sospeso
+size_t strip_comments_finish(CommentState *state, char *output)
+{
+    size_t out_len = 0;
+    if (*state == COMMENT_STATE_SLASH)
+        output[out_len++] = '/';
+    *state = COMMENT_STATE_CODE;
+    return out_len;
 }
 
+// Blocchi elaborati di seguito da rimozione dei commenti e compattazione
+#define COMPACT_BLOCK_SIZE (64 * 1024)
+
 // Rimuove tutti i commenti dal codice
 char *remove_comments(const char *content, PreCompiler *compiler)
 {
@@ -572,87 +1222,42 @@ char *remove_comments(const char *content, PreCompiler *compiler)
         return NULL;
     }
 
-    // Copia il contenuto rimuovendo i commenti
-    size_t result_len = 0;
-    bool in_line_comment = false;
-    bool in_block_comment = false;
-
-    for (size_t i = 0; i < content_len; i++)
+    // Copia il contenuto rimuovendo i commenti, tenendo conto di stringhe e caratteri letterali
+    CommentState state = COMMENT_STATE_CODE;
+    size_t result_len;
+    if (!compiler->compact)
     {
-        if (in_line_comment)
-        {
-            // In un commento di linea, continua fino a un newline
-            if (content[i] == '\n')
-            {
-                in_line_comment = false;
-                result[result_len++] = content[i];
-            }
-        }
-        else if (in_block_comment)
+        comment_probes(state, content, content_len, 0);
+        result_len = strip_comments(&state, content, content_len, result, &compiler->stats.comment_lines_deleted);
+        result_len += strip_comments_finish(&state, result + result_len);
+    }
+    else
+    {
+        // La compattazione segue l'automa blocco per blocco, mentre il testo è
+        // ancora in cache. Scrive sul posto: non produce mai più byte di quanti
+        // ne abbia letti, quindi resta dietro alla posizione di lettura.
+        Compactor compactor;
+        compactor_init(&compactor);
+        size_t stripped_len = 0;
+        result_len = 0;
+        for (size_t offset = 0; offset < content_len; offset += COMPACT_BLOCK_SIZE)
         {
-            // In un commento di blocco, controlla la fine del commento
-            if (content[i] == '*' && i + 1 < content_len && content[i + 1] == '/')
-            {
-                in_block_comment = false;
-                i++; // Salta il carattere '/'
-                compiler->stats.comment_lines_deleted++;
-            }
-            else if (content[i] == '\n')
-            {
-                result[result_len++] = content[i];
-                compiler->stats.comment_lines_deleted++;
-            }
-        }
-        else
-        {
-            // Non in un commento, verifica l'inizio di un commento
-            if (content[i] == '/' && i + 1 < content_len)
-            {
-                if (content[i + 1] == '/')
-                {
-                    // Commento di linea
-                    in_line_comment = true;
-                    compiler->stats.comment_lines_deleted++;
-                    i++; // Salta il secondo carattere '/'
-                }
-                else if (content[i + 1] == '*')
-                {
-                    // Commento di blocco
-                    in_block_comment = true;
-                    i++; // Salta il carattere '*'
-                }
-                else
-                {
-                    // Non è un commento, copia normalmente
-                    result[result_len++] = content[i];
-                }
-            }
-            else
-            {
-                // Copia normalmente
-                result[result_len++] = content[i];
-            }
+            size_t n = content_len - offset < COMPACT_BLOCK_SIZE ? content_len - offset : COMPACT_BLOCK_SIZE;
+            comment_probes(state, content + offset, n, offset);
+            size_t stripped = strip_comments(&state, content + offset, n, result + stripped_len,
+                                             &compiler->stats.comment_lines_deleted);
+            result_len += compact_lines(&compactor, result + stripped_len, stripped, result + result_len);
+            stripped_len += stripped;
         }
+        size_t tail = strip_comments_finish(&state, result + stripped_len);
+        result_len += compact_lines(&compactor, result + stripped_len, tail, result + result_len);
+        compactor_free(&compactor);
     }
 
     result[result_len] = '\0';
     return result;
 }
 
-// Funzione per calcolare la larghezza massima per una colonna
-size_t get_max_width(const char *header, const char **values, int count) {
-    size_t max_width = strlen(header);
-    
-    for (int i = 0; i < count; i++) {
-        size_t value_length = values[i] ? strlen(values[i]) : 0;
-        if (value_length > max_width) {
-            max_width = value_length;
-        }
-    }
-    
-    return max_width + 2; // Aggiungi spaziatura
-}
-
 // Stampa una linea di separazione per la tabella
 void print_table_separator(size_t *widths, int num_columns) {
     for (int i = 0; i < num_columns; i++) {
@@ -686,63 +1291,13 @@ void print_stats(const PreCompiler *compiler)
         return;
 
     fprintf(stdout, "\n==== Statistiche di elaborazione ====\n");
+    if (compiler->aborted)
+        fprintf(stdout, "Elaborazione interrotta da un limite: valori parziali\n");
     fprintf(stdout, "Numero di variabili controllate: %d\n", compiler->stats.checked_vars);
-    fprintf(stdout, "Numero di errori rilevati: %d\n", compiler->stats.errors_detected);
-
-    // Stampa i dettagli degli errori
-    if (compiler->stats.errors_detected > 0)
-    {
-        fprintf(stdout, "\nDettaglio degli errori rilevati:\n");
-        
-        // Prepara le intestazioni
-        const char *headers[] = {"File", "Linea", "Variabile"};
-        int num_columns = 3;
-        
-        // Prepara i dati per il calcolo delle larghezze
-        char **filenames = malloc(compiler->stats.errors_detected * sizeof(char*));
-        char **line_numbers = malloc(compiler->stats.errors_detected * sizeof(char*));
-        char **var_names = malloc(compiler->stats.errors_detected * sizeof(char*));
-        
-        for (int i = 0; i < compiler->stats.errors_detected; i++) {
-            filenames[i] = compiler->errors[i]->filename;
-            
-            // Converti i numeri di linea in stringhe
-            line_numbers[i] = malloc(20);
-            sprintf(line_numbers[i], "%d", compiler->errors[i]->line_number);
-            
-            var_names[i] = compiler->errors[i]->var_name;
-        }
-        
-        // Calcola le larghezze delle colonne
-        size_t widths[3];
-        widths[0] = get_max_width(headers[0], (const char**)filenames, compiler->stats.errors_detected);
-        widths[1] = get_max_width(headers[1], (const char**)line_numbers, compiler->stats.errors_detected);
-        widths[2] = get_max_width(headers[2], (const char**)var_names, compiler->stats.errors_detected);
-        
-        // Stampa la tabella
-        print_table_separator(widths, num_columns);
-        print_table_header(headers, widths, num_columns);
-        print_table_separator(widths, num_columns);
-        
-        for (int i = 0; i < compiler->stats.errors_detected; i++) {
-            const char *values[] = {
-                compiler->errors[i]->filename,
-                line_numbers[i],
-                compiler->errors[i]->var_name
-            };
-            print_table_row(values, widths, num_columns);
-            print_table_separator(widths, num_columns);
-        }
-        
-        // Libera la memoria allocata
-        for (int i = 0; i < compiler->stats.errors_detected; i++) {
-            free(line_numbers[i]);
-        }
-        free(filenames);
-        free(line_numbers);
-        free(var_names);
-    }
+    fprintf(stdout, "Numero di errori rilevati: %d%s\n", compiler->stats.errors_detected,
+            compiler->diagnostics.limit_reached ? " (limite --max-errors raggiunto)" : "");
 
+    // I dettagli degli errori sono già stati scritti dal sink durante il controllo
     fprintf(stdout, "\nNumero di righe di commento eliminate: %d\n", compiler->stats.comment_lines_deleted);
     fprintf(stdout, "Numero di file inclusi: %d\n", compiler->stats.files_included);
 
@@ -755,27 +1310,24 @@ void print_stats(const PreCompiler *compiler)
         const char *headers[] = {"File", "Dimensione", "Righe"};
         int num_columns = 3;
         
-        // Prepara i dati per il calcolo delle larghezze
-        char **filenames = malloc(compiler->stats.files_included * sizeof(char*));
-        char **sizes = malloc(compiler->stats.files_included * sizeof(char*));
-        char **lines = malloc(compiler->stats.files_included * sizeof(char*));
-        
+        // Calcola le larghezze delle colonne senza allocare stringhe intermedie
+        size_t widths[3] = {strlen(headers[0]), strlen(headers[1]), strlen(headers[2])};
         for (int i = 0; i < compiler->stats.files_included; i++) {
-            filenames[i] = compiler->included_files[i]->filename;
-            
-            // Converte dimensioni e righe in stringhe
-            sizes[i] = malloc(20);
-            sprintf(sizes[i], "%d", compiler->included_files[i]->size);
-            
-            lines[i] = malloc(20);
-            sprintf(lines[i], "%d", compiler->included_files[i]->lines);
+            const IncludedFile *file = compiler->included_files[i];
+            size_t lengths[3] = {
+                strlen(file->filename),
+                (size_t)snprintf(NULL, 0, "%d", file->size),
+                (size_t)snprintf(NULL, 0, "%d", file->lines)
+            };
+            for (int c = 0; c < num_columns; c++) {
+                if (lengths[c] > widths[c]) {
+                    widths[c] = lengths[c];
+                }
+            }
+        }
+        for (int c = 0; c < num_columns; c++) {
+            widths[c] += 2; // Aggiungi spaziatura
         }
-        
-        // Calcola le larghezze delle colonne
-        size_t widths[3];
-        widths[0] = get_max_width(headers[0], (const char**)filenames, compiler->stats.files_included);
-        widths[1] = get_max_width(headers[1], (const char**)sizes, compiler->stats.files_included);
-        widths[2] = get_max_width(headers[2], (const char**)lines, compiler->stats.files_included);
         
         // Stampa la tabella
         print_table_separator(widths, num_columns);
@@ -783,26 +1335,70 @@ void print_stats(const PreCompiler *compiler)
         print_table_separator(widths, num_columns);
         
         for (int i = 0; i < compiler->stats.files_included; i++) {
+            char size[16], lines[16];
+            snprintf(size, sizeof(size), "%d", compiler->included_files[i]->size);
+            snprintf(lines, sizeof(lines), "%d", compiler->included_files[i]->lines);
             const char *values[] = {
                 compiler->included_files[i]->filename,
-                sizes[i],
-                lines[i]
+                size,
+                lines
             };
             print_table_row(values, widths, num_columns);
             print_table_separator(widths, num_columns);
         }
-        
-        // Libera la memoria allocata
-        for (int i = 0; i < compiler->stats.files_included; i++) {
-            free(sizes[i]);
-            free(lines[i]);
-        }
-        free(filenames);
-        free(sizes);
-        free(lines);
     }
 
-    fprintf(stdout, "\nFile di input (%s):\n", compiler->input_filename);
+    // In modalità unity: statistiche di ogni unità e poi il totale
+    if (compiler->unit_count > 0)
+    {
+        fprintf(stdout, "\nDettaglio delle unità di compilazione:\n");
+
+        const char *headers[] = {"File", "Righe input", "Righe output", "Variabili", "Errori", "Nuovi include"};
+        int num_columns = 6;
+        char cells[6][16];
+        size_t widths[6];
+        for (int c = 0; c < num_columns; c++)
+            widths[c] = strlen(headers[c]);
+        for (int i = 0; i < compiler->unit_count; i++)
+        {
+            const Stats *unit = &compiler->units[i].stats;
+            int numbers[5] = {unit->input_lines, unit->output_lines, unit->checked_vars, unit->errors_detected, unit->files_included};
+            size_t filename_len = strlen(compiler->units[i].filename);
+            if (filename_len > widths[0])
+                widths[0] = filename_len;
+            for (int c = 1; c < num_columns; c++)
+            {
+                size_t len = (size_t)snprintf(NULL, 0, "%d", numbers[c - 1]);
+                if (len > widths[c])
+                    widths[c] = len;
+            }
+        }
+        for (int c = 0; c < num_columns; c++)
+            widths[c] += 2;
+
+        print_table_separator(widths, num_columns);
+        print_table_header(headers, widths, num_columns);
+        print_table_separator(widths, num_columns);
+        for (int i = 0; i < compiler->unit_count; i++)
+        {
+            const Stats *unit = &compiler->units[i].stats;
+            int numbers[5] = {unit->input_lines, unit->output_lines, unit->checked_vars, unit->errors_detected, unit->files_included};
+            const char *values[6] = {compiler->units[i].filename};
+            for (int c = 1; c < num_columns; c++)
+            {
+                snprintf(cells[c], sizeof(cells[c]), "%d", numbers[c - 1]);
+                values[c] = cells[c];
+            }
+            print_table_row(values, widths, num_columns);
+            print_table_separator(widths, num_columns);
+        }
+
+        fprintf(stdout, "\nFile di input (%d unità di compilazione):\n", compiler->unit_count);
+    }
+    else
+    {
+        fprintf(stdout, "\nFile di input (%s):\n", compiler->input_filename);
+    }
     fprintf(stdout, "  Dimensione: %d byte\n", compiler->stats.input_size);
     fprintf(stdout, "  Righe: %d\n", compiler->stats.input_lines);
 
@@ -811,9 +1407,160 @@ void print_stats(const PreCompiler *compiler)
     {
         fprintf(stdout, " (%s)", compiler->output_filename);
     }
+    if (compiler->output_unchanged)
+    {
+        fprintf(stdout, " invariato, non riscritto");
+    }
     fprintf(stdout, ":\n");
     fprintf(stdout, "  Dimensione: %d byte\n", compiler->stats.output_size);
     fprintf(stdout, "  Righe: %d\n", compiler->stats.output_lines);
 
     fprintf(stdout, "\n===================================\n");
-}
\ No newline at end of file
+}
+
+// Confronta due file inclusi per costo totale decrescente
+static int compare_include_cost(const void *a, const void *b)
+{
+    const IncludedFile *fa = *(const IncludedFile *const *)a;
+    const IncludedFile *fb = *(const IncludedFile *const *)b;
+    if (fa->total_ns != fb->total_ns)
+        return fa->total_ns < fb->total_ns ? 1 : -1;
+    return strcmp(fa->filename, fb->filename);
+}
+
+// Stampa il report dei costi dei file inclusi, ordinato per costo
+void print_include_report(const PreCompiler *compiler)
+{
+    if (!compiler)
+        return;
+
+    int count = compiler->stats.files_included;
+    fprintf(stdout, "\n==== Costo dei file inclusi ====\n");
+    if (count == 0)
+    {
+        fprintf(stdout, "Nessun file incluso\n");
+        return;
+    }
+
+    IncludedFile **sorted = (IncludedFile **)malloc(count * sizeof(IncludedFile *));
+    if (!sorted)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il report dei file inclusi\n");
+        return;
+    }
+    memcpy(sorted, compiler->included_files, count * sizeof(IncludedFile *));
+    qsort(sorted, count, sizeof(IncludedFile *), compare_include_cost);
+
+    const char *headers[] = {"File", "Richieste", "Byte senza commenti", "Lettura (us)", "Totale (us)", "Profondita'", "Incluso da"};
+    int num_columns = 7;
+
+    // Prepara i valori testuali di ogni riga in un unico blocco
+    char (*cells)[6][32] = malloc(count * sizeof(*cells));
+    if (!cells)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il report dei file inclusi\n");
+        free(sorted);
+        return;
+    }
+
+    size_t widths[7];
+    for (int c = 0; c < num_columns; c++)
+    {
+        widths[c] = strlen(headers[c]);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const IncludedFile *file = sorted[i];
+        const char *parent = file->parent < 0 ? compiler->input_filename : compiler->included_files[file->parent]->filename;
+        snprintf(cells[i][0], sizeof(cells[i][0]), "%d", file->requests);
+        snprintf(cells[i][1], sizeof(cells[i][1]), "%d", file->stripped_size);
+        snprintf(cells[i][2], sizeof(cells[i][2]), "%.1f", file->read_ns / 1000.0);
+        snprintf(cells[i][3], sizeof(cells[i][3]), "%.1f", file->total_ns / 1000.0);
+        snprintf(cells[i][4], sizeof(cells[i][4]), "%d", file->depth);
+
+        if (strlen(file->filename) > widths[0])
+            widths[0] = strlen(file->filename);
+        for (int c = 0; c < 5; c++)
+        {
+            if (strlen(cells[i][c]) > widths[c + 1])
+                widths[c + 1] = strlen(cells[i][c]);
+        }
+        if (strlen(parent) > widths[6])
+            widths[6] = strlen(parent);
+    }
+    for (int c = 0; c < num_columns; c++)
+    {
+        widths[c] += 2; // Aggiungi spaziatura
+    }
+
+    print_table_separator(widths, num_columns);
+    print_table_header(headers, widths, num_columns);
+    print_table_separator(widths, num_columns);
+    for (int i = 0; i < count; i++)
+    {
+        const IncludedFile *file = sorted[i];
+        const char *values[] = {
+            file->filename,
+            cells[i][0],
+            cells[i][1],
+            cells[i][2],
+            cells[i][3],
+            cells[i][4],
+            file->parent < 0 ? compiler->input_filename : compiler->included_files[file->parent]->filename};
+        print_table_row(values, widths, num_columns);
+        print_table_separator(widths, num_columns);
+    }
+
+    free(cells);
+    free(sorted);
+}
+
+// Scrive i costi dei file inclusi in formato folded-stack (flame graph).
+// Ogni riga riporta la catena di inclusione e il tempo proprio del file in nanosecondi.
+// I nomi con separatori del formato vengono scritti con '_' al loro posto.
+int write_include_folded(const PreCompiler *compiler, const char *filename)
+{
+    int count = compiler->stats.files_included;
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Errore: impossibile aprire il file %s\n", filename);
+        return 1;
+    }
+
+    // Il tempo proprio esclude quello degli include annidati
+    uint64_t *self_ns = (uint64_t *)malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    if (!self_ns)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il report dei file inclusi\n");
+        fclose(file);
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        self_ns[i] = compiler->included_files[i]->total_ns;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int parent = compiler->included_files[i]->parent;
+        if (parent >= 0)
+        {
+            uint64_t child = compiler->included_files[i]->total_ns;
+            self_ns[parent] = self_ns[parent] > child ? self_ns[parent] - child : 0;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        write_include_chain(file, compiler, i, ";", true);
+        fprintf(file, " %llu\n", (unsigned long long)self_ns[i]);
+    }
+
+    free(self_ns);
+    if (fclose(file) != 0)
+    {
+        fprintf(stderr, "Errore: impossibile scrivere il file %s\n", filename);
+        return 1;
+    }
+    return 0;
+}
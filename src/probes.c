@@ -0,0 +1,13 @@
+#include "../include/probes.h"
+
+#ifdef HAVE_SDT
+// Semafori dei probe USDT: il tracer li incrementa quando si aggancia al probe
+#define PROBE_DEFINE(name) volatile unsigned short PROBE_SEMAPHORE(name) __attribute__((section(".probes")))
+
+PROBE_DEFINE(include__open);
+PROBE_DEFINE(include__close);
+PROBE_DEFINE(invalid__name);
+PROBE_DEFINE(comment__start);
+PROBE_DEFINE(comment__end);
+PROBE_DEFINE(output__write);
+#endif
@@ -0,0 +1,337 @@
+#include "../include/precompiler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Dimensione dei blocchi letti dall'input e passati alle fasi successive
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+// Elaborazione a blocchi successiva alla risoluzione degli #include:
+// rimozione dei commenti, controllo dei nomi e scrittura dell'output
+typedef struct
+{
+    PreCompiler *compiler;
+    OutputWriter *writer;      // Destinazione dell'output (NULL = solo controllo)
+    CommentState comments;
+    size_t offset;             // Byte del testo espanso già elaborati
+    Compactor compactor;
+    bool compact;              // Compatta le righe vuote prima del parser e dell'output
+    DeclScanner scanner;
+    bool scanning;             // Il parser non è stato interrotto
+    bool failed;               // Scrittura dell'output fallita
+    char last;                 // Ultimo byte scritto, per contare le righe
+    char buffer[STREAM_CHUNK_SIZE + 1];
+    char *compacted;           // Output della compattazione, cresce con gli spazi in sospeso
+    size_t compacted_capacity;
+} Stream;
+
+static Stream *stream_open(PreCompiler *compiler, OutputWriter *writer)
+{
+    Stream *stream = (Stream *)malloc(sizeof(Stream));
+    if (!stream)
+    {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'elaborazione a blocchi\n");
+        return NULL;
+    }
+    stream->compiler = compiler;
+    stream->writer = writer;
+    stream->comments = COMMENT_STATE_CODE;
+    stream->offset = 0;
+    compactor_init(&stream->compactor);
+    stream->compact = compiler->compact && writer;
+    stream->compacted = NULL;
+    stream->compacted_capacity = 0;
+    stream->scanning = (compiler->passes & PASS_CHECK) && !compiler->diagnostics.limit_reached;
+    stream->failed = false;
+    stream->last = '\n';
+    decl_scanner_init(&stream->scanner, report_declared_name, compiler);
+    return stream;
+}
+
+// Passa un blocco già privo di commenti al parser e all'output
+static int stream_emit(Stream *stream, const char *data, size_t len)
+{
+    if (stream->compact)
+    {
+        size_t capacity = compact_capacity(&stream->compactor, len);
+        if (capacity > stream->compacted_capacity)
+        {
+            char *compacted = (char *)realloc(stream->compacted, capacity);
+            if (!compacted)
+            {
+                fprintf(stderr, "Errore: impossibile allocare memoria per la compattazione\n");
+                return 1;
+            }
+            stream->compacted = compacted;
+            stream->compacted_capacity = capacity;
+        }
+        len = compact_lines(&stream->compactor, data, len, stream->compacted);
+        data = stream->compacted;
+    }
+    if (len == 0)
+        return 0;
+    if (stream->scanning)
+        stream->scanning = decl_scanner_feed(&stream->scanner, data, len);
+    if (stream->writer)
+    {
+        Stats *stats = &stream->compiler->stats;
+        for (const char *p = data, *end = data + len; (p = memchr(p, '\n', end - p)) != NULL; p++)
+            stats->output_lines++;
+        stats->output_size += (int)len;
+        stream->last = data[len - 1];
+
+        if (myprecompiler_output__write_ENABLED())
+            PROBE2(output__write, stream->compiler->output_filename ? stream->compiler->output_filename : "-", len);
+        if (output_write(stream->writer, data, len) != 0)
+        {
+            stream->failed = true;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Elabora un blocco di testo con gli #include già risolti
+static int stream_feed(Stream *stream, const char *data, size_t len)
+{
+    // Senza output, quando il parser si ferma non resta nulla da fare
+    while (len > 0 && (stream->scanning || stream->writer))
+    {
+        size_t n = len < STREAM_CHUNK_SIZE ? len : STREAM_CHUNK_SIZE;
+        int status;
+        if (stream->compiler->passes & PASS_COMMENTS)
+        {
+            comment_probes(stream->comments, data, n, stream->offset);
+            size_t stripped = strip_comments(&stream->comments, data, n, stream->buffer,
+                                             &stream->compiler->stats.comment_lines_deleted);
+            status = stream_emit(stream, stream->buffer, stripped);
+        }
+        else
+        {
+            status = stream_emit(stream, data, n);
+        }
+        if (status != 0)
+            return 1;
+        stream->offset += n;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Riceve l'output di resolve_includes
+static int stream_sink(void *context, const char *data, size_t len)
+{
+    return stream_feed((Stream *)context, data, len);
+}
+
+// Completa l'elaborazione alla fine dell'input
+static int stream_finish(Stream *stream)
+{
+    // Un eventuale '/' in sospeso chiude l'input
+    size_t tail = strip_comments_finish(&stream->comments, stream->buffer);
+    if (stream_emit(stream, stream->buffer, tail) != 0)
+        return 1;
+    if (stream->scanning)
+        decl_scanner_finish(&stream->scanner);
+    if (stream->writer && stream->compiler->stats.output_size > 0 && stream->last != '\n')
+        stream->compiler->stats.output_lines++;
+    return 0;
+}
+
+static void stream_close(Stream *stream)
+{
+    decl_scanner_free(&stream->scanner);
+    compactor_free(&stream->compactor);
+    free(stream->compacted);
+    free(stream);
+}
+
+// Elabora una porzione di input composta da righe complete
+static int stream_process(Stream *stream, const char *content)
+{
+    PreCompiler *compiler = stream->compiler;
+    if (!(compiler->passes & PASS_INCLUDES))
+        return stream_feed(stream, content, strlen(content));
+
+    compiler->include_sink = stream_sink;
+    compiler->include_sink_context = stream;
+    char *rest = resolve_includes(content, compiler);
+    compiler->include_sink = NULL;
+    compiler->include_sink_context = NULL;
+
+    free(rest);
+    return rest && !compiler->aborted ? 0 : 1;
+}
+
+// Controlla i nomi senza produrre output
+int check_variables_only(const char *content, PreCompiler *compiler)
+{
+    Stream *stream = stream_open(compiler, NULL);
+    if (!stream)
+        return 1;
+
+    int status = stream_process(stream, content);
+    if (status == 0)
+        status = stream_finish(stream);
+    stream_close(stream);
+    return status;
+}
+
+// Vero se l'input va letto come flusso: stdin ("-"), pipe, FIFO o dispositivo
+bool is_stream_input(const char *filename)
+{
+    if (strcmp(filename, "-") == 0)
+        return true;
+    if (codec_from_filename(filename) != CODEC_NONE)
+        return false;
+    struct stat st;
+    return stat(filename, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+// Legge l'input a blocchi ed elabora ogni gruppo di righe complete appena
+// arriva, scrivendo l'output man mano: in una pipeline della shell il primo
+// risultato esce senza attendere la fine dell'input
+int run_streaming(PreCompiler *compiler)
+{
+    bool from_stdin = strcmp(compiler->input_filename, "-") == 0;
+    int fd = from_stdin ? STDIN_FILENO : open(compiler->input_filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Errore: impossibile aprire il file %s\n", compiler->input_filename);
+        return 1;
+    }
+
+    OutputWriter writer;
+    bool has_output = compiler->passes & PASS_OUTPUT;
+    if (has_output && output_open(&writer, compiler->output_filename, compiler->only_if_changed) != 0)
+    {
+        if (!from_stdin)
+            close(fd);
+        return 1;
+    }
+
+    Stream *stream = stream_open(compiler, has_output ? &writer : NULL);
+    size_t capacity = STREAM_CHUNK_SIZE + 1;
+    char *buffer = (char *)malloc(capacity);
+    if (!stream || !buffer)
+    {
+        if (stream)
+            stream_close(stream);
+        else
+            fprintf(stderr, "Errore: impossibile allocare memoria per la lettura\n");
+        free(buffer);
+        if (has_output)
+            output_abort(&writer);
+        if (!from_stdin)
+            close(fd);
+        return 1;
+    }
+
+    trace_begin("stage", "stream");
+    uint64_t start = monotonic_ns();
+    size_t pending = 0;        // Byte di una riga non ancora completa
+    size_t consumed = 0;       // Byte già elaborati, per la posizione degli errori UTF-8
+    bool utf8_reported = false;
+    int status = 0;
+    for (;;)
+    {
+        // Il buffer cresce solo se una singola riga supera il blocco
+        if (capacity - pending < STREAM_CHUNK_SIZE + 1)
+        {
+            capacity *= 2;
+            char *new_buffer = (char *)realloc(buffer, capacity);
+            if (!new_buffer)
+            {
+                fprintf(stderr, "Errore: impossibile allocare memoria per la lettura\n");
+                status = 1;
+                break;
+            }
+            buffer = new_buffer;
+        }
+
+        ssize_t n = read(fd, buffer + pending, STREAM_CHUNK_SIZE);
+        if (n < 0)
+        {
+            fprintf(stderr, "Errore: impossibile leggere il file %s\n", compiler->input_filename);
+            status = 1;
+            break;
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (buffer[pending + i] == '\n')
+                compiler->stats.input_lines++;
+        }
+        compiler->stats.input_size += (int)n;
+        pending += (size_t)n;
+
+        // Elabora fino all'ultimo newline; alla fine dell'input elabora tutto
+        size_t ready = pending;
+        if (n > 0)
+        {
+            while (ready > 0 && buffer[ready - 1] != '\n')
+                ready--;
+        }
+        else if (pending > 0)
+        {
+            compiler->stats.input_lines++;
+        }
+
+        if (ready > 0)
+        {
+            size_t error_offset;
+            if (!utf8_reported && !utf8_validate(buffer, ready, &error_offset))
+            {
+                fprintf(stderr, "Avviso: sequenza UTF-8 non valida in %s all'offset %zu\n",
+                        compiler->input_filename, consumed + error_offset);
+                utf8_reported = true;
+            }
+
+            char saved = buffer[ready];
+            buffer[ready] = '\0';
+            status = stream_process(stream, buffer);
+            buffer[ready] = saved;
+            if (status != 0)
+                break;
+
+            memmove(buffer, buffer + ready, pending - ready);
+            pending -= ready;
+            consumed += ready;
+            if (has_output && !compiler->output_filename)
+                fflush(stdout);
+        }
+        if (n == 0)
+            break;
+    }
+
+    if (status == 0)
+        status = stream_finish(stream);
+    // Le fasi si alternano blocco per blocco: il tempo complessivo viene attribuito alla lettura
+    compiler->stage_ns[STAGE_READ] = monotonic_ns() - start;
+    compiler->stage_ran[STAGE_READ] = true;
+    trace_end();
+
+    stream_close(stream);
+    free(buffer);
+    if (!from_stdin)
+        close(fd);
+
+    if (has_output)
+    {
+        if (status != 0)
+        {
+            output_abort(&writer);
+        }
+        else if (output_commit(&writer) != 0)
+        {
+            status = 1;
+        }
+        else
+        {
+            compiler->output_unchanged = !writer.changed;
+        }
+    }
+    return status;
+}
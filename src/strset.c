@@ -0,0 +1,112 @@
+#include "../include/strset.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Hash FNV-1a
+static uint64_t strset_hash(const char *text, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Restituisce lo slot che contiene la stringa o il primo slot libero della sequenza
+static size_t strset_find(const StringSet *set, const char *text, size_t len)
+{
+    size_t mask = set->capacity - 1;
+    size_t i = (size_t)strset_hash(text, len) & mask;
+    while (set->slots[i] && (strncmp(set->slots[i], text, len) != 0 || set->slots[i][len] != '\0'))
+        i = (i + 1) & mask;
+    return i;
+}
+
+void strset_init(StringSet *set)
+{
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+
+// Raddoppia la tabella mantenendo il fattore di carico sotto 1/2
+static int strset_grow(StringSet *set)
+{
+    size_t old_capacity = set->capacity;
+    char **old_slots = set->slots;
+
+    set->capacity = old_capacity ? old_capacity * 2 : 16;
+    set->slots = (char **)calloc(set->capacity, sizeof(char *));
+    if (!set->slots)
+    {
+        set->slots = old_slots;
+        set->capacity = old_capacity;
+        return 1;
+    }
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_slots[i])
+            set->slots[strset_find(set, old_slots[i], strlen(old_slots[i]))] = old_slots[i];
+    }
+    free(old_slots);
+    return 0;
+}
+
+int strset_add(StringSet *set, const char *text)
+{
+    size_t len = strlen(text);
+    if ((set->count + 1) * 2 > set->capacity && strset_grow(set) != 0)
+        return 1;
+
+    size_t i = strset_find(set, text, len);
+    if (set->slots[i])
+        return 0;
+
+    set->slots[i] = strdup(text);
+    if (!set->slots[i])
+        return 1;
+    set->count++;
+    return 0;
+}
+
+int strset_add_list(StringSet *set, const char *list)
+{
+    while (*list)
+    {
+        size_t len = strcspn(list, ",");
+        if (len > 0)
+        {
+            char *item = strndup(list, len);
+            if (!item || strset_add(set, item) != 0)
+            {
+                free(item);
+                return 1;
+            }
+            free(item);
+        }
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+    return 0;
+}
+
+bool strset_contains(const StringSet *set, const char *text, size_t len)
+{
+    if (set->count == 0)
+        return false;
+    return set->slots[strset_find(set, text, len)] != NULL;
+}
+
+void strset_free(StringSet *set)
+{
+    for (size_t i = 0; i < set->capacity; i++)
+        free(set->slots[i]);
+    free(set->slots);
+    strset_init(set);
+}
@@ -0,0 +1,175 @@
+#include "../include/precompiler.h"
+
+#include <pthread.h>
+
+bool trace_enabled = false;
+
+// Origine dei tempi del trace
+static uint64_t trace_origin_ns;
+
+// Lista dei buffer di tutti i thread, protetta da trace_lock
+static TraceBuffer *trace_buffers = NULL;
+static int trace_next_tid = 1;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Buffer del thread corrente
+static __thread TraceBuffer *local_buffer = NULL;
+
+// Attiva la registrazione; i tempi sono relativi a questo istante
+void trace_start(void)
+{
+    trace_origin_ns = monotonic_ns();
+    trace_enabled = true;
+}
+
+// Restituisce il buffer del thread corrente, creandolo al primo evento
+static TraceBuffer *thread_buffer(void)
+{
+    if (local_buffer)
+        return local_buffer;
+
+    TraceBuffer *buffer = (TraceBuffer *)calloc(1, sizeof(TraceBuffer));
+    if (!buffer)
+        return NULL;
+
+    pthread_mutex_lock(&trace_lock);
+    buffer->tid = trace_next_tid++;
+    buffer->next = trace_buffers;
+    trace_buffers = buffer;
+    pthread_mutex_unlock(&trace_lock);
+
+    local_buffer = buffer;
+    return buffer;
+}
+
+// Aggiunge un evento al buffer del thread corrente
+static void trace_push(char phase, const char *category, const char *name)
+{
+    uint64_t now = monotonic_ns();
+    TraceBuffer *buffer = thread_buffer();
+    if (!buffer)
+        return;
+
+    if (buffer->count == buffer->capacity)
+    {
+        size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        TraceEvent *events = (TraceEvent *)realloc(buffer->events, new_capacity * sizeof(TraceEvent));
+        if (!events)
+            return;
+        buffer->events = events;
+        buffer->capacity = new_capacity;
+    }
+
+    TraceEvent *event = &buffer->events[buffer->count++];
+    event->ts_ns = now;
+    event->phase = phase;
+    event->category = category;
+    event->name = name ? strdup(name) : NULL;
+}
+
+// Assegna un nome alla traccia del thread corrente
+void trace_set_thread_name(const char *name)
+{
+    if (!trace_enabled)
+        return;
+    TraceBuffer *buffer = thread_buffer();
+    if (!buffer)
+        return;
+    free(buffer->thread_name);
+    buffer->thread_name = strdup(name);
+}
+
+// Apre un intervallo annidato nel thread corrente
+void trace_begin(const char *category, const char *name)
+{
+    if (trace_enabled)
+        trace_push('B', category, name);
+}
+
+// Chiude l'ultimo intervallo aperto nel thread corrente
+void trace_end(void)
+{
+    if (trace_enabled)
+        trace_push('E', NULL, NULL);
+}
+
+// Scrive una stringa JSON con l'escape dei caratteri speciali
+static void write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(file, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(file, "\\u%04x", *p);
+        else
+            fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+// Scrive gli eventi nel formato Chrome Trace Event e libera i buffer
+int trace_write(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Errore: impossibile aprire il file di trace %s\n", filename);
+        return 1;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (TraceBuffer *buffer = trace_buffers; buffer; buffer = buffer->next)
+    {
+        if (buffer->thread_name)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                    first ? "" : ",\n", buffer->tid);
+            write_json_string(file, buffer->thread_name);
+            fputs("}}", file);
+            first = false;
+        }
+        for (size_t i = 0; i < buffer->count; i++)
+        {
+            const TraceEvent *event = &buffer->events[i];
+            // I timestamp sono in microsecondi
+            double ts = (event->ts_ns - trace_origin_ns) / 1000.0;
+            fprintf(file, "%s{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", first ? "" : ",\n",
+                    event->phase, ts, buffer->tid);
+            if (event->name)
+            {
+                fputs(",\"name\":", file);
+                write_json_string(file, event->name);
+                fprintf(file, ",\"cat\":\"%s\"", event->category);
+            }
+            fputc('}', file);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    // Libera i buffer: il trace viene scritto una sola volta alla fine
+    while (trace_buffers)
+    {
+        TraceBuffer *buffer = trace_buffers;
+        trace_buffers = buffer->next;
+        for (size_t i = 0; i < buffer->count; i++)
+            free(buffer->events[i].name);
+        free(buffer->events);
+        free(buffer->thread_name);
+        free(buffer);
+    }
+    local_buffer = NULL;
+    trace_enabled = false;
+    pthread_mutex_unlock(&trace_lock);
+
+    if (fclose(file) != 0)
+    {
+        fprintf(stderr, "Errore: impossibile scrivere il file di trace %s\n", filename);
+        return 1;
+    }
+    return 0;
+}
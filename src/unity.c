@@ -0,0 +1,135 @@
+#include "../include/precompiler.h"
+
+// Sottrae le statistiche precedenti a quelle attuali, per isolare un'unità
+static Stats stats_delta(const Stats *after, const Stats *before)
+{
+    Stats delta;
+    delta.checked_vars = after->checked_vars - before->checked_vars;
+    delta.errors_detected = after->errors_detected - before->errors_detected;
+    delta.comment_lines_deleted = after->comment_lines_deleted - before->comment_lines_deleted;
+    delta.files_included = after->files_included - before->files_included;
+    delta.input_size = after->input_size - before->input_size;
+    delta.input_lines = after->input_lines - before->input_lines;
+    delta.output_size = after->output_size - before->output_size;
+    delta.output_lines = after->output_lines - before->output_lines;
+    return delta;
+}
+
+// Esegue un passo su content, sostituendolo con il risultato e misurandone la durata
+static char *run_pass(PreCompiler *compiler, Stage stage, char *(*pass)(const char *, PreCompiler *), char *content)
+{
+    trace_begin("stage", stage_name(stage));
+    uint64_t start = monotonic_ns();
+    char *result = pass(content, compiler);
+    compiler->stage_ns[stage] += monotonic_ns() - start;
+    compiler->stage_ran[stage] = true;
+    trace_end();
+    free(content);
+    return result;
+}
+
+// Elabora una singola unità e ne accoda il risultato all'output
+static int process_unit(PreCompiler *compiler, OutputWriter *writer, bool last_unit)
+{
+    trace_begin("stage", stage_name(STAGE_READ));
+    uint64_t start = monotonic_ns();
+    int input_size, input_lines;
+    char *content = read_file_content(compiler, compiler->input_filename, &input_size, &input_lines);
+    compiler->stage_ns[STAGE_READ] += monotonic_ns() - start;
+    compiler->stage_ran[STAGE_READ] = true;
+    trace_end();
+    if (!content)
+        return 1;
+    compiler->stats.input_size += input_size;
+    compiler->stats.input_lines += input_lines;
+
+    // La tabella included_files è condivisa: gli header già espansi da
+    // un'unità precedente vengono saltati come inclusioni ripetute
+    if (compiler->passes & PASS_INCLUDES && !(content = run_pass(compiler, STAGE_INCLUDES, resolve_includes, content)))
+        return 1;
+    if (compiler->passes & PASS_COMMENTS && !(content = run_pass(compiler, STAGE_COMMENTS, remove_comments, content)))
+        return 1;
+    if (compiler->passes & PASS_CHECK && !(content = run_pass(compiler, STAGE_CHECK, check_variables_name, content)))
+        return 1;
+
+    int status = 0;
+    if (writer)
+    {
+        trace_begin("stage", stage_name(STAGE_WRITE));
+        start = monotonic_ns();
+        size_t len = strlen(content);
+        for (const char *p = content, *end = content + len; (p = memchr(p, '\n', end - p)) != NULL; p++)
+            compiler->stats.output_lines++;
+        compiler->stats.output_size += (int)len;
+
+        if (myprecompiler_output__write_ENABLED())
+            PROBE2(output__write, compiler->output_filename ? compiler->output_filename : "-", len);
+        status = output_write(writer, content, len);
+
+        // Ogni unità inizia su una nuova riga
+        if (status == 0 && len > 0 && content[len - 1] != '\n')
+        {
+            if (last_unit)
+            {
+                compiler->stats.output_lines++;
+            }
+            else
+            {
+                status = output_write(writer, "\n", 1);
+                compiler->stats.output_size++;
+                compiler->stats.output_lines++;
+            }
+        }
+        compiler->stage_ns[STAGE_WRITE] += monotonic_ns() - start;
+        compiler->stage_ran[STAGE_WRITE] = true;
+        trace_end();
+    }
+
+    free(content);
+    return status;
+}
+
+// Elabora tutte le unità di compilazione scrivendo un unico output
+int run_unity(PreCompiler *compiler)
+{
+    OutputWriter writer;
+    bool has_output = compiler->passes & PASS_OUTPUT;
+    if (has_output && output_open(&writer, compiler->output_filename, compiler->only_if_changed) != 0)
+        return 1;
+
+    // Le diagnostiche e la catena di inclusione usano il nome dell'unità corrente
+    char *root_filename = compiler->input_filename;
+    int status = 0;
+    for (int i = 0; i < compiler->unit_count && status == 0; i++)
+    {
+        TranslationUnit *unit = &compiler->units[i];
+        Stats before = compiler->stats;
+
+        compiler->input_filename = unit->filename;
+        trace_begin("file", unit->filename);
+        status = process_unit(compiler, has_output ? &writer : NULL, i == compiler->unit_count - 1);
+        trace_end();
+        compiler->input_filename = root_filename;
+
+        unit->stats = stats_delta(&compiler->stats, &before);
+        if (status == 0 && time_budget_exceeded(compiler, "la unity build"))
+            status = 1;
+    }
+
+    if (has_output)
+    {
+        if (status != 0)
+        {
+            output_abort(&writer);
+        }
+        else if (output_commit(&writer) != 0)
+        {
+            status = 1;
+        }
+        else
+        {
+            compiler->output_unchanged = !writer.changed;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,169 @@
+#include "../include/utf8.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Intervallo chiuso di code point
+typedef struct
+{
+    uint32_t first;
+    uint32_t last;
+} CodepointRange;
+
+// Caratteri ammessi negli identificatori (C11, allegato D.1), ordinati
+static const CodepointRange identifier_ranges[] = {
+    {0x00A8, 0x00A8}, {0x00AA, 0x00AA}, {0x00AD, 0x00AD}, {0x00AF, 0x00AF},
+    {0x00B2, 0x00B5}, {0x00B7, 0x00BA}, {0x00BC, 0x00BE}, {0x00C0, 0x00D6},
+    {0x00D8, 0x00F6}, {0x00F8, 0x167F}, {0x1681, 0x180D}, {0x180F, 0x1FFF},
+    {0x200B, 0x200D}, {0x202A, 0x202E}, {0x203F, 0x2040}, {0x2054, 0x2054},
+    {0x2060, 0x218F}, {0x2460, 0x24FF}, {0x2776, 0x2793}, {0x2C00, 0x2DFF},
+    {0x2E80, 0x2FFF}, {0x3004, 0x3007}, {0x3021, 0x302F}, {0x3031, 0xD7FF},
+    {0xF900, 0xFD3D}, {0xFD40, 0xFDCF}, {0xFDF0, 0xFE44}, {0xFE47, 0xFFFD},
+    {0x10000, 0x1FFFD}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}, {0x40000, 0x4FFFD},
+    {0x50000, 0x5FFFD}, {0x60000, 0x6FFFD}, {0x70000, 0x7FFFD}, {0x80000, 0x8FFFD},
+    {0x90000, 0x9FFFD}, {0xA0000, 0xAFFFD}, {0xB0000, 0xBFFFD}, {0xC0000, 0xCFFFD},
+    {0xD0000, 0xDFFFD}, {0xE0000, 0xEFFFD},
+};
+
+// Caratteri ammessi ma non come primo carattere (C11, allegato D.2)
+static const CodepointRange combining_ranges[] = {
+    {0x0300, 0x036F}, {0x1DC0, 0x1DFF}, {0x20D0, 0x20FF}, {0xFE20, 0xFE2F},
+};
+
+// Ricerca binaria in una tabella di intervalli ordinati
+static bool in_ranges(const CodepointRange *ranges, size_t count, uint32_t codepoint)
+{
+    size_t low = 0, high = count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (codepoint < ranges[mid].first)
+            high = mid;
+        else if (codepoint > ranges[mid].last)
+            low = mid + 1;
+        else
+            return true;
+    }
+    return false;
+}
+
+bool utf8_is_identifier_start(uint32_t codepoint)
+{
+    return in_ranges(identifier_ranges, sizeof(identifier_ranges) / sizeof(identifier_ranges[0]), codepoint) &&
+           !in_ranges(combining_ranges, sizeof(combining_ranges) / sizeof(combining_ranges[0]), codepoint);
+}
+
+bool utf8_is_identifier_continue(uint32_t codepoint)
+{
+    return in_ranges(identifier_ranges, sizeof(identifier_ranges) / sizeof(identifier_ranges[0]), codepoint);
+}
+
+// Decodifica un carattere UTF-8 all'inizio di s (al massimo len byte)
+size_t utf8_decode(const unsigned char *s, size_t len, uint32_t *codepoint)
+{
+    if (len == 0)
+        return 0;
+
+    unsigned char c = s[0];
+    if (c < 0x80)
+    {
+        *codepoint = c;
+        return 1;
+    }
+
+    size_t needed;
+    uint32_t value, min;
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+        needed = 2;
+        value = c & 0x1F;
+        min = 0x80;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        needed = 3;
+        value = c & 0x0F;
+        min = 0x800;
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        needed = 4;
+        value = c & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        // Byte di continuazione isolato o primo byte mai valido (C0, C1, F5-FF)
+        return 0;
+    }
+
+    if (len < needed)
+        return 0;
+    for (size_t i = 1; i < needed; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+
+    // Forme sovralunghe, surrogati e valori oltre l'ultimo code point
+    if (value < min || (value >= 0xD800 && value <= 0xDFFF) || value > 0x10FFFF)
+        return 0;
+
+    *codepoint = value;
+    return needed;
+}
+
+// Lunghezza del prefisso composto da soli caratteri ASCII
+static size_t ascii_prefix(const unsigned char *data, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    // Il bit alto di ogni byte finisce nella maschera: zero significa 16 byte ASCII
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        int mask = _mm_movemask_epi8(chunk);
+        if (mask != 0)
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+#else
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word & 0x8080808080808080ull)
+            break;
+    }
+#endif
+    while (i < len && data[i] < 0x80)
+        i++;
+    return i;
+}
+
+// Verifica che il buffer sia UTF-8 valido
+bool utf8_validate(const char *data, size_t len, size_t *error_offset)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i = 0;
+    while (i < len)
+    {
+        i += ascii_prefix(bytes + i, len - i);
+        if (i == len)
+            break;
+
+        uint32_t codepoint;
+        size_t used = utf8_decode(bytes + i, len - i, &codepoint);
+        if (used == 0)
+        {
+            if (error_offset)
+                *error_offset = i;
+            return false;
+        }
+        i += used;
+    }
+    return true;
+}
@@ -0,0 +1,3 @@
+// Intestazione con spazio e punto e virgola nel nome
+#include "tests/folded_inner.h"
+int folded_outer;
@@ -0,0 +1 @@
+int folded_inner;
@@ -0,0 +1,7 @@
+// Nomi di file con separatori del formato folded-stack
+#include "tests/folded name;v2.h"
+
+int main(void)
+{
+    return folded_outer + folded_inner;
+}
@@ -0,0 +1,25 @@
+// Dichiarazioni con tipi definiti da typedef: i nomi vanno controllati
+typedef unsigned long size_t;
+typedef struct _IO_FILE FILE;
+
+struct Buffer
+{
+    size_t 3q;
+    FILE *5f;
+    size_t count;
+    FILE *stream;
+};
+
+int main(void)
+{
+    int 2m = 0;
+    size_t 1n = 0;
+    FILE *6p = 0;
+    size_t total = 0;
+    FILE *out = 0;
+    int 4r;
+    for (size_t 7i = 0; 7i < 3; 7i++)
+        total *= 2;
+    total = total * 2;
+    return 0;
+}